@@ -50,7 +50,7 @@ class BlockchainTest(BitcoinTestFramework):
 
     def _test_gettxoutsetinfo(self):
         node = self.nodes[0]
-        res = node.gettxoutsetinfo()
+        res = node.gettxoutsetinfo('hash_serialized_2')
 
         assert_equal(res['total_amount'], Decimal('8725.00000000'))
         assert_equal(res['transactions'], 200)
@@ -63,11 +63,20 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
 
+        print ("Test that the maintained gettxoutsetinfo() agrees with the one going through the set")
+        resmu = node.gettxoutsetinfo()
+        assert_equal(resmu['total_amount'], res['total_amount'])
+        assert_equal(resmu['height'], res['height'])
+        assert_equal(resmu['txouts'], res['txouts'])
+        assert_equal(resmu['bestblock'], res['bestblock'])
+        assert_equal(len(resmu['muhash']), 64)
+        assert (resmu['bogosize'] > 0)
+
         print ("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
         node.invalidateblock(b1hash)
 
-        res2 = node.gettxoutsetinfo()
+        res2 = node.gettxoutsetinfo('hash_serialized_2')
         assert_equal(res2['transactions'], 0)
         assert_equal(res2['total_amount'], Decimal('0'))
         assert_equal(res2['height'], 0)
@@ -75,16 +84,25 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res2['bestblock'], node.getblockhash(0))
         assert_equal(len(res2['hash_serialized_2']), 64)
 
+        res2mu = node.gettxoutsetinfo()
+        assert_equal(res2mu['total_amount'], Decimal('0'))
+        assert_equal(res2mu['txouts'], 0)
+        assert_equal(res2mu['bogosize'], 0)
+        assert (res2mu['muhash'] != resmu['muhash'])
+
         print ("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
 
-        res3 = node.gettxoutsetinfo()
+        res3 = node.gettxoutsetinfo('hash_serialized_2')
         assert_equal(res['total_amount'], res3['total_amount'])
         assert_equal(res['transactions'], res3['transactions'])
         assert_equal(res['height'], res3['height'])
         assert_equal(res['txouts'], res3['txouts'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        res3mu = node.gettxoutsetinfo()
+        for key in ['total_amount', 'txouts', 'bogosize', 'muhash', 'bestblock']:
+            assert_equal(res3mu[key], resmu[key])
 
     def _test_getblockheader(self):
         node = self.nodes[0]
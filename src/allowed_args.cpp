@@ -6,6 +6,7 @@
 #include <set>
 
 #include "allowed_args.h"
+#include "blockcache.h"
 #include "chainparams.h"
 #include "dosman.h"
 #include "httpserver.h"
@@ -230,6 +231,10 @@ static void addGeneralOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
     allowedArgs.addHeader(_("General options:"))
         .addArg("alertnotify=<cmd>", requiredStr, _("Execute command when a relevant alert is received or we see a "
                                                     "really long fork (%s in cmd is replaced by message)"))
+        .addArg("backgroundflush", optionalBool,
+            strprintf(_("Write the coin database cache to disk on a background thread, using up to twice -dbcache "
+                        "memory while a write is in flight (default: %u)"),
+                    DEFAULT_BACKGROUND_FLUSH))
         .addArg("blocknotify=<cmd>", requiredStr,
             _("Execute command when the best block changes (%s in cmd is replaced by block hash)"))
         .addDebugArg("blocksonly", optionalBool,
@@ -254,6 +259,9 @@ static void addGeneralOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
         .addArg("dbcache=<n>", requiredInt, strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"),
                                                 nMinDbCache, nMaxDbCache, nDefaultDbCache))
         .addArg("loadblock=<file>", requiredStr, _("Imports blocks from external blk000??.dat file on startup"))
+        .addArg("loadutxosnapshot=<file>", requiredStr,
+            _("Once the block headers up to its base block are known, replace the chain state with a UTXO "
+              "snapshot written by dumptxoutset. Blocks before the base are not downloaded or validated"))
         .addArg("maxorphantx=<n>", requiredInt,
             strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"),
                     DEFAULT_MAX_ORPHAN_TRANSACTIONS))
@@ -534,6 +542,9 @@ static void addDebuggingOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
                          DEFAULT_RELAYPRIORITY))
         .addDebugArg("maxsigcachesize=<n>", requiredInt,
             strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE))
+        .addDebugArg("maxscriptcachesize=<n>", requiredInt,
+            strprintf("Limit size of the cache of transactions whose scripts were verified to <n> MiB (default: %u)",
+                         DEFAULT_MAX_SCRIPT_CACHE_SIZE))
         .addArg("printtoconsole", optionalBool, _("Send trace/debug info to console instead of debug.log file"))
         .addDebugArg("printpriority", optionalBool,
             strprintf("Log transaction priority and fee per kB when mining blocks (default: %u)",
@@ -551,6 +562,9 @@ static void addNodeRelayOptions(AllowedArgs &allowedArgs)
     allowedArgs.addHeader(_("Node relay options:"))
         .addDebugArg("acceptnonstdtxn", optionalBool,
             strprintf("Relay and mine \"non-standard\" transactions (%sdefault: %u)", "testnet/regtest only; ", true))
+        .addArg("blockcachesize=<n>", requiredInt,
+            strprintf(_("Keep up to <n> MiB of recently served blocks for other peers asking for them (default: %u)"),
+                    DEFAULT_BLOCK_CACHE_SIZE))
         .addArg("bytespersigop=<n>", requiredInt,
             strprintf(_("Minimum bytes per sigop in transactions we relay and mine (default: %u)"),
                     DEFAULT_BYTES_PER_SIGOP))
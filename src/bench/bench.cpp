@@ -24,12 +24,14 @@ BenchRunner::BenchRunner(std::string name, BenchFunction func)
 }
 
 void
-BenchRunner::RunAll(double elapsedTimeForOne)
+BenchRunner::RunAll(double elapsedTimeForOne, const std::string &filter)
 {
     std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
 
     for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
          it != benchmarks.end(); ++it) {
+        if (it->first.find(filter) == std::string::npos)
+            continue;
 
         State state(it->first, elapsedTimeForOne);
         BenchFunction& func = it->second;
@@ -62,7 +62,8 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        // Run the benchmarks whose name contains filter, or all of them if it is empty
+        static void RunAll(double elapsedTimeForOne=1.0, const std::string &filter="");
     };
 }
 
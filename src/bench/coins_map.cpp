@@ -0,0 +1,98 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "crypto/common.h"
+#include "random.h"
+
+#include <unordered_map>
+
+// The coins cache as it was before CCoinsMap became a CFlatHashMap, for comparison
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CStdCoinsMap;
+
+static COutPoint BenchOutPoint(uint64_t i)
+{
+    uint256 hash;
+    WriteLE64(hash.begin(), i);
+    return COutPoint(hash, i % 4);
+}
+
+static Coin BenchCoin(uint64_t i)
+{
+    // A P2PKH output, which is the common case and fits in the inline storage of CScript
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY
+                               << OP_CHECKSIG;
+    return Coin(CTxOut(i, script), i / 1000, false);
+}
+
+template <typename Map>
+static void Fill(Map &map, size_t nEntries)
+{
+    for (size_t i = 0; i < nEntries; i++)
+    {
+        CCoinsCacheEntry &entry = map[BenchOutPoint(i)];
+        entry.coin = BenchCoin(i);
+        entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+    }
+}
+
+template <typename Map>
+static void CoinsMapInsert(benchmark::State &state, size_t nEntries)
+{
+    while (state.KeepRunning())
+    {
+        Map map;
+        Fill(map, nEntries);
+    }
+}
+
+template <typename Map>
+static void CoinsMapLookup(benchmark::State &state, size_t nEntries)
+{
+    Map map;
+    Fill(map, nEntries);
+    uint64_t nFound = 0;
+    while (state.KeepRunning())
+    {
+        // Random lookups, a quarter of them for coins that are not there
+        for (int i = 0; i < 100000; i++)
+            nFound += map.count(BenchOutPoint(insecure_rand() % (nEntries + nEntries / 3)));
+    }
+    assert(nFound > 0);
+}
+
+/** Move all coins from one cache to the other and back, each time through CCoinsViewCache::Flush(). */
+static void CoinsCacheFlush(benchmark::State &state, size_t nEntries)
+{
+    CCoinsView root;
+    CCoinsViewCache a(&root), b(&root);
+    for (size_t i = 0; i < nEntries; i++)
+        a.AddCoin(BenchOutPoint(i), BenchCoin(i), false);
+    CCoinsViewCache *from = &a, *to = &b;
+    while (state.KeepRunning())
+    {
+        from->SetBackend(*to);
+        from->Flush();
+        std::swap(from, to);
+    }
+}
+
+static void CoinsMapInsert_10M(benchmark::State &state) { CoinsMapInsert<CCoinsMap>(state, 10000000); }
+static void CoinsMapInsert_50M(benchmark::State &state) { CoinsMapInsert<CCoinsMap>(state, 50000000); }
+static void CoinsMapLookup_10M(benchmark::State &state) { CoinsMapLookup<CCoinsMap>(state, 10000000); }
+static void CoinsMapLookup_50M(benchmark::State &state) { CoinsMapLookup<CCoinsMap>(state, 50000000); }
+static void CoinsCacheFlush_10M(benchmark::State &state) { CoinsCacheFlush(state, 10000000); }
+static void CoinsCacheFlush_50M(benchmark::State &state) { CoinsCacheFlush(state, 50000000); }
+static void StdCoinsMapInsert_10M(benchmark::State &state) { CoinsMapInsert<CStdCoinsMap>(state, 10000000); }
+static void StdCoinsMapLookup_10M(benchmark::State &state) { CoinsMapLookup<CStdCoinsMap>(state, 10000000); }
+
+BENCHMARK(CoinsMapInsert_10M);
+BENCHMARK(CoinsMapInsert_50M);
+BENCHMARK(CoinsMapLookup_10M);
+BENCHMARK(CoinsMapLookup_50M);
+BENCHMARK(CoinsCacheFlush_10M);
+BENCHMARK(CoinsCacheFlush_50M);
+BENCHMARK(StdCoinsMapInsert_10M);
+BENCHMARK(StdCoinsMapLookup_10M);
@@ -54,6 +54,46 @@ static void SHA256_32b(benchmark::State &state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State &state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+        SHA256D64(in.data(), in.data(), 1024);
+}
+
+/**
+ * Run a SHA256 benchmark with only the given implementations enabled, and go back to the autodetected
+ * best one afterwards. On a CPU that lacks an implementation this measures the fallback instead.
+ */
+static void UsingSHA256(sha256_implementation::UseImplementation use_implementation,
+    void (*bench)(benchmark::State &),
+    benchmark::State &state)
+{
+    SHA256AutoDetect(use_implementation);
+    bench(state);
+    SHA256AutoDetect();
+}
+
+static void SHA256_STANDARD(benchmark::State &state) { UsingSHA256(sha256_implementation::STANDARD, SHA256, state); }
+static void SHA256_SSE4(benchmark::State &state) { UsingSHA256(sha256_implementation::USE_SSE4, SHA256, state); }
+static void SHA256_SHANI(benchmark::State &state) { UsingSHA256(sha256_implementation::USE_SHANI, SHA256, state); }
+static void SHA256D64_1024_STANDARD(benchmark::State &state)
+{
+    UsingSHA256(sha256_implementation::STANDARD, SHA256D64_1024, state);
+}
+static void SHA256D64_1024_SSE4(benchmark::State &state)
+{
+    UsingSHA256(sha256_implementation::USE_SSE4, SHA256D64_1024, state);
+}
+static void SHA256D64_1024_AVX2(benchmark::State &state)
+{
+    UsingSHA256(sha256_implementation::USE_AVX2, SHA256D64_1024, state);
+}
+static void SHA256D64_1024_SHANI(benchmark::State &state)
+{
+    UsingSHA256(sha256_implementation::USE_SHANI, SHA256D64_1024, state);
+}
+
 static void SHA512(benchmark::State &state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -102,6 +142,14 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256_STANDARD);
+BENCHMARK(SHA256_SSE4);
+BENCHMARK(SHA256_SHANI);
+BENCHMARK(SHA256D64_1024_STANDARD);
+BENCHMARK(SHA256D64_1024_SSE4);
+BENCHMARK(SHA256D64_1024_AVX2);
+BENCHMARK(SHA256D64_1024_SHANI);
 // BENCHMARK(SipHash_32b);
 // BENCHMARK(FastRandom_32bit);
 // BENCHMARK(FastRandom_1bit);
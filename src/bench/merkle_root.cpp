@@ -0,0 +1,59 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/merkle.h"
+#include "parallel.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+static std::vector<uint256> MerkleLeaves(size_t nLeaves)
+{
+    std::vector<uint256> leaves(nLeaves);
+    for (size_t i = 0; i < nLeaves; i++)
+        leaves[i] = GetRandHash();
+    return leaves;
+}
+
+static void MerkleRootSerial(benchmark::State &state, size_t nLeaves)
+{
+    std::vector<uint256> leaves = MerkleLeaves(nLeaves);
+    bool mutated;
+    while (state.KeepRunning())
+        ComputeMerkleRoot(leaves, &mutated);
+}
+
+static void MerkleRootParallel(benchmark::State &state, size_t nLeaves)
+{
+    std::vector<uint256> leaves = MerkleLeaves(nLeaves);
+    unsigned int nThreads = std::max(1U, boost::thread::hardware_concurrency());
+    CCheckQueue<CMerkleSubtree> queue(1, nThreads);
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CMerkleSubtree>::Thread, &queue));
+
+    bool mutated;
+    while (state.KeepRunning())
+        ComputeMerkleRootParallel(leaves, &mutated, &queue, nThreads);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void MerkleRoot_10k(benchmark::State &state) { MerkleRootSerial(state, 10000); }
+static void MerkleRoot_100k(benchmark::State &state) { MerkleRootSerial(state, 100000); }
+static void MerkleRoot_1M(benchmark::State &state) { MerkleRootSerial(state, 1000000); }
+static void MerkleRootParallel_10k(benchmark::State &state) { MerkleRootParallel(state, 10000); }
+static void MerkleRootParallel_100k(benchmark::State &state) { MerkleRootParallel(state, 100000); }
+static void MerkleRootParallel_1M(benchmark::State &state) { MerkleRootParallel(state, 1000000); }
+
+BENCHMARK(MerkleRoot_10k);
+BENCHMARK(MerkleRoot_100k);
+BENCHMARK(MerkleRoot_1M);
+BENCHMARK(MerkleRootParallel_10k);
+BENCHMARK(MerkleRootParallel_100k);
+BENCHMARK(MerkleRootParallel_1M);
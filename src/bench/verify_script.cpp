@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "arith_uint256.h"
 #include "key.h"
 #if defined(HAVE_CONSENSUS_LIB)
 #include "script/bitcoinconsensus.h"
@@ -91,3 +92,51 @@ static void VerifyScriptBench(benchmark::State &state)
 }
 
 BENCHMARK(VerifyScriptBench);
+
+// Build a transaction with many inputs, such as a large consolidation transaction.
+static CTransaction BuildManyInputTransaction(unsigned int nInputs)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.nLockTime = 0;
+    tx.vin.resize(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++)
+    {
+        tx.vin[i].prevout.hash = ArithToUint256(arith_uint256(i + 1));
+        tx.vin[i].prevout.n = i % 4;
+        tx.vin[i].nSequence = CTxIn::SEQUENCE_FINAL;
+    }
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = nInputs;
+    return tx;
+}
+
+// Compute the SIGHASH_FORKID signature hash of every input of a 2000 input transaction, recomputing the
+// prevout, sequence and output hashes for each input.
+static void SighashForkIdManyInputs(benchmark::State &state)
+{
+    const CTransaction tx = BuildManyInputTransaction(2000);
+    const CScript scriptCode = CScript() << OP_TRUE;
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHashBitcoinCash(scriptCode, tx, i, SIGHASH_ALL | SIGHASH_FORKID, 1);
+    }
+}
+
+// As above, but using per transaction precomputed data as is done during block and mempool validation.
+static void SighashForkIdManyInputsPrecomputed(benchmark::State &state)
+{
+    const CTransaction tx = BuildManyInputTransaction(2000);
+    const CScript scriptCode = CScript() << OP_TRUE;
+    while (state.KeepRunning())
+    {
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHashBitcoinCash(scriptCode, tx, i, SIGHASH_ALL | SIGHASH_FORKID, 1, NULL, &txdata);
+    }
+}
+
+BENCHMARK(SighashForkIdManyInputs);
+BENCHMARK(SighashForkIdManyInputsPrecomputed);
@@ -0,0 +1,144 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "chain.h"
+#include "core_memusage.h"
+#include "main.h"
+#include "memusage.h"
+#include "primitives/block.h"
+#include "stat.h"
+#include "util.h"
+
+extern CStatHistory<uint64_t> nBlockCacheHits;
+extern CStatHistory<uint64_t> nBlockCacheMisses;
+extern CStatHistory<uint64_t> nBlockCacheEvictions;
+
+//! Memory used by an entry besides the block itself, for its list and map nodes
+static const size_t BLOCK_CACHE_ENTRY_OVERHEAD = 256;
+
+const CBlockCache::Entry *CBlockCache::Find(const uint256 &hash, Encoding encoding)
+{
+    AssertLockHeld(cs);
+    auto it = mapEntries.find(std::make_pair(hash, encoding));
+    if (it == mapEntries.end())
+    {
+        nBlockCacheMisses << 1;
+        return NULL;
+    }
+    nBlockCacheHits << 1;
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    return &*it->second;
+}
+
+void CBlockCache::Insert(Entry &entry)
+{
+    AssertLockHeld(cs);
+    std::pair<uint256, Encoding> key(entry.hash, entry.encoding);
+    if (entry.nUsage > nMaxUsage || mapEntries.count(key))
+        return;
+    nUsage += entry.nUsage;
+    listEntries.push_front(std::move(entry));
+    mapEntries[key] = listEntries.begin();
+    while (nUsage > nMaxUsage)
+    {
+        const Entry &last = listEntries.back();
+        nUsage -= last.nUsage;
+        mapEntries.erase(std::make_pair(last.hash, last.encoding));
+        listEntries.pop_back();
+        nBlockCacheEvictions << 1;
+    }
+}
+
+bool CBlockCache::GetSerialized(const uint256 &hash, CBlockFileSpan &span)
+{
+    LOCK(cs);
+    const Entry *pentry = Find(hash, SERIALIZED);
+    if (!pentry)
+        return false;
+    span = pentry->span;
+    return true;
+}
+
+void CBlockCache::PutSerialized(const uint256 &hash, const CBlockFileSpan &span)
+{
+    Entry entry;
+    entry.hash = hash;
+    entry.encoding = SERIALIZED;
+    entry.span = span;
+    entry.nUsage = span.size() + BLOCK_CACHE_ENTRY_OVERHEAD;
+    LOCK(cs);
+    Insert(entry);
+}
+
+std::shared_ptr<const CBlock> CBlockCache::GetDecoded(const uint256 &hash)
+{
+    LOCK(cs);
+    const Entry *pentry = Find(hash, DECODED);
+    return pentry ? pentry->pblock : nullptr;
+}
+
+void CBlockCache::PutDecoded(const std::shared_ptr<const CBlock> &pblock)
+{
+    Entry entry;
+    entry.hash = pblock->GetHash();
+    entry.encoding = DECODED;
+    entry.pblock = pblock;
+    entry.nUsage = memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(*pblock) + BLOCK_CACHE_ENTRY_OVERHEAD;
+    LOCK(cs);
+    Insert(entry);
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    mapEntries.clear();
+    listEntries.clear();
+    nUsage = 0;
+}
+
+size_t CBlockCache::size() const
+{
+    LOCK(cs);
+    return listEntries.size();
+}
+
+size_t CBlockCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
+
+CBlockCache &GetBlockCache()
+{
+    static CBlockCache blockCache(GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE) * ((size_t)1 << 20));
+    return blockCache;
+}
+
+bool ReadServedRawBlock(CBlockFileSpan &span,
+    const CBlockIndex *pindex,
+    const CMessageHeader::MessageStartChars &messageStart)
+{
+    CBlockCache &cache = GetBlockCache();
+    if (cache.GetSerialized(pindex->GetBlockHash(), span))
+        return true;
+    if (!ReadRawBlockFromDisk(span, pindex, messageStart))
+        return false;
+    cache.PutSerialized(pindex->GetBlockHash(), span);
+    return true;
+}
+
+std::shared_ptr<const CBlock> ReadServedBlock(const CBlockIndex *pindex, const Consensus::Params &consensusParams)
+{
+    CBlockCache &cache = GetBlockCache();
+    std::shared_ptr<const CBlock> pblock = cache.GetDecoded(pindex->GetBlockHash());
+    if (pblock)
+        return pblock;
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+        return nullptr;
+    cache.PutDecoded(pblockRead);
+    return pblockRead;
+}
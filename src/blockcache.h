@@ -0,0 +1,90 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "blockfilemap.h"
+#include "protocol.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+class CBlock;
+class CBlockIndex;
+
+namespace Consensus
+{
+struct Params;
+}
+
+/** -blockcachesize default, in MiB */
+static const unsigned int DEFAULT_BLOCK_CACHE_SIZE = 64;
+
+/**
+ * Recently served blocks, shared by all peers, so that when many of them ask for a new block at once it is
+ * only read and decoded the first time.
+ *
+ * Blocks are kept in the forms that do not depend on who asked: the serialized block as sent in a block
+ * message, and the decoded block that thin blocks, xthin blocks, their missing transactions and merkle
+ * blocks are built from for each peer's filter.  The least recently used entries go once the memory used
+ * is over the limit.
+ */
+class CBlockCache
+{
+public:
+    enum Encoding
+    {
+        SERIALIZED,
+        DECODED
+    };
+
+private:
+    struct Entry
+    {
+        uint256 hash;
+        Encoding encoding;
+        CBlockFileSpan span;
+        std::shared_ptr<const CBlock> pblock;
+        size_t nUsage;
+    };
+    typedef std::list<Entry> EntryList;
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    //! Most recently used first
+    EntryList listEntries;
+    std::map<std::pair<uint256, Encoding>, EntryList::iterator> mapEntries;
+
+    const Entry *Find(const uint256 &hash, Encoding encoding);
+    void Insert(Entry &entry);
+
+public:
+    explicit CBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0) {}
+    bool GetSerialized(const uint256 &hash, CBlockFileSpan &span);
+    void PutSerialized(const uint256 &hash, const CBlockFileSpan &span);
+    std::shared_ptr<const CBlock> GetDecoded(const uint256 &hash);
+    void PutDecoded(const std::shared_ptr<const CBlock> &pblock);
+
+    void Clear();
+    size_t size() const;
+    size_t DynamicMemoryUsage() const;
+};
+
+/** The cache shared by all peers, sized by -blockcachesize */
+CBlockCache &GetBlockCache();
+
+/** ReadRawBlockFromDisk for serving a block, going through the shared cache */
+bool ReadServedRawBlock(CBlockFileSpan &span,
+    const CBlockIndex *pindex,
+    const CMessageHeader::MessageStartChars &messageStart);
+
+/** ReadBlockFromDisk for serving a block, going through the shared cache */
+std::shared_ptr<const CBlock> ReadServedBlock(const CBlockIndex *pindex, const Consensus::Params &consensusParams);
+
+#endif // BITCOIN_BLOCKCACHE_H
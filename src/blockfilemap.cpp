@@ -0,0 +1,88 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "main.h"
+#include "sync.h"
+#include "util.h"
+
+#include <list>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! How many block file mappings are kept around, fewer where address space is short
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void *) >= 8 ? 64 : 4;
+
+static CCriticalSection cs_mappedBlockFiles;
+//! Most recently used first
+static std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile> > > listMappedBlockFiles;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void *)pbegin, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CMappedBlockFile::Map(const fs::path &path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        LogPrint("blk", "Unable to map %s\n", path.string());
+        return nullptr;
+    }
+    return std::shared_ptr<const CMappedBlockFile>(new CMappedBlockFile((const unsigned char *)p, st.st_size));
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> MapBlockFile(int nFile, size_t nMinSize)
+{
+    LOCK(cs_mappedBlockFiles);
+    for (auto it = listMappedBlockFiles.begin(); it != listMappedBlockFiles.end(); ++it)
+    {
+        if (it->first != nFile)
+            continue;
+        if (it->second->size() >= nMinSize)
+        {
+            listMappedBlockFiles.splice(listMappedBlockFiles.begin(), listMappedBlockFiles, it);
+            return it->second;
+        }
+        // The file has grown since it was mapped, readers of the old mapping keep it until they are done
+        listMappedBlockFiles.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> file = CMappedBlockFile::Map(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (!file || file->size() < nMinSize)
+        return nullptr;
+    listMappedBlockFiles.push_front(std::make_pair(nFile, file));
+    if (listMappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        listMappedBlockFiles.pop_back();
+    return file;
+}
+
+void UnmapBlockFile(int nFile)
+{
+    LOCK(cs_mappedBlockFiles);
+    listMappedBlockFiles.remove_if(
+        [nFile](const std::pair<int, std::shared_ptr<const CMappedBlockFile> > &item) { return item.first == nFile; });
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "fs.h"
+
+#include <memory>
+#include <stddef.h>
+
+/**
+ * A read only memory mapping of a whole blk?????.dat file, unmapped when the last reference to it is
+ * dropped.
+ *
+ * Mappings outlive the removal of their file, so a block that is being read or sent when its file is
+ * pruned stays readable until it is done with.
+ */
+class CMappedBlockFile
+{
+private:
+    const unsigned char *pbegin;
+    size_t nSize;
+
+    CMappedBlockFile(const unsigned char *pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+public:
+    ~CMappedBlockFile();
+    CMappedBlockFile(const CMappedBlockFile &) = delete;
+    CMappedBlockFile &operator=(const CMappedBlockFile &) = delete;
+
+    //! Map the file as it is now, NULL if it can not be mapped
+    static std::shared_ptr<const CMappedBlockFile> Map(const fs::path &path);
+
+    const unsigned char *data() const { return pbegin; }
+    size_t size() const { return nSize; }
+};
+
+/** A range of bytes read from a block file, together with whatever keeps them in memory. */
+class CBlockFileSpan
+{
+private:
+    std::shared_ptr<const void> owner;
+    const unsigned char *pbegin;
+    size_t nSize;
+
+public:
+    CBlockFileSpan() : pbegin(NULL), nSize(0) {}
+    CBlockFileSpan(std::shared_ptr<const void> ownerIn, const unsigned char *pbeginIn, size_t nSizeIn)
+        : owner(std::move(ownerIn)), pbegin(pbeginIn), nSize(nSizeIn)
+    {
+    }
+
+    const unsigned char *data() const { return pbegin; }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    const unsigned char *begin() const { return pbegin; }
+    const unsigned char *end() const { return pbegin + nSize; }
+};
+
+/**
+ * The mapping of block file nFile, covering at least its first nMinSize bytes.  Mappings are cached, a
+ * file that has grown past the cached one is mapped again.  NULL if the file can not be mapped, for
+ * example on platforms without mmap.
+ */
+std::shared_ptr<const CMappedBlockFile> MapBlockFile(int nFile, size_t nMinSize);
+
+/** Forget the cached mapping of a block file that is about to be truncated or removed. */
+void UnmapBlockFile(int nFile);
+
+#endif // BITCOIN_BLOCKFILEMAP_H
@@ -6,8 +6,52 @@
 
 #include "chain.h"
 
+#include "memusage.h"
+
+#include <new>
+#include <type_traits>
+
 using namespace std;
 
+CBlockIndex *CBlockIndexPool::Take()
+{
+    if (vChunks.empty() || nUsed == vChunks.back().second)
+        Reserve(CHUNK_SIZE);
+    nSize++;
+    return vChunks.back().first + nUsed++;
+}
+
+CBlockIndex *CBlockIndexPool::Allocate() { return new (Take()) CBlockIndex(); }
+CBlockIndex *CBlockIndexPool::Allocate(const CBlockHeader &block) { return new (Take()) CBlockIndex(block); }
+void CBlockIndexPool::Reserve(size_t nCount)
+{
+    if (!vChunks.empty() && vChunks.back().second - nUsed >= nCount)
+        return;
+    // What is left of the current chunk is not used
+    size_t nCapacity = std::max(nCount, CHUNK_SIZE);
+    CBlockIndex *pchunk = static_cast<CBlockIndex *>(::operator new(nCapacity * sizeof(CBlockIndex)));
+    vChunks.push_back(std::make_pair(pchunk, nCapacity));
+    nUsed = 0;
+}
+
+void CBlockIndexPool::Clear()
+{
+    static_assert(std::is_trivially_destructible<CBlockIndex>::value, "entries are dropped without destroying them");
+    for (const auto &chunk : vChunks)
+        ::operator delete(chunk.first);
+    std::vector<std::pair<CBlockIndex *, size_t> >().swap(vChunks);
+    nUsed = 0;
+    nSize = 0;
+}
+
+size_t CBlockIndexPool::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vChunks);
+    for (const auto &chunk : vChunks)
+        nUsage += memusage::MallocUsage(chunk.second * sizeof(CBlockIndex));
+    return nUsage;
+}
+
 /**
  * CChain implementation
  */
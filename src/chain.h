@@ -145,6 +145,9 @@ enum BlockStatus : uint32_t
     BLOCK_FAILED_VALID = 64, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 128, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    //! Block was never downloaded, the coins it created were loaded from a UTXO snapshot
+    BLOCK_ASSUMED_VALID = 256,
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -155,6 +158,9 @@ enum BlockStatus : uint32_t
 class CBlockIndex
 {
 public:
+    // The fields used when walking and comparing chains come first, so that they share a cache line.  The
+    // rest is ordered to leave no padding.
+
     //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
     const uint256 *phashBlock;
 
@@ -167,38 +173,38 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
-
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
     //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
     arith_uint256 nChainWork;
 
+    //! (memory only) Number of transactions in the chain up to and including this block.
+    //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
+    uint64_t nChainTx;
+
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
 
-    //! (memory only) Number of transactions in the chain up to and including this block.
-    //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
-    uint64_t nChainTx;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
 
     //! block header
     int nVersion;
-    uint256 hashMerkleRoot;
     unsigned int nTime;
     unsigned int nBits;
     unsigned int nNonce;
-
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
+    uint256 hashMerkleRoot;
 
     void SetNull()
     {
@@ -415,6 +421,45 @@ public:
     }
 };
 
+/**
+ * Allocator of the entries of the block index, which hands them out of large contiguous chunks.
+ *
+ * Block index entries are only ever added, and are all dropped together, so they need no individual
+ * frees.  Allocating them this way saves the per allocation overhead of the heap, and keeps entries that
+ * are created one after the other, such as those loaded at startup in height order, next to each other.
+ * Not thread safe, the block index is only added to under cs_main.
+ */
+class CBlockIndexPool
+{
+private:
+    //! Number of entries in a chunk, unless a larger one was reserved
+    static const size_t CHUNK_SIZE = 4096;
+
+    //! The chunks and their capacity, entries are taken from the last one
+    std::vector<std::pair<CBlockIndex *, size_t> > vChunks;
+    //! Number of entries taken from the last chunk
+    size_t nUsed;
+    size_t nSize;
+
+    CBlockIndex *Take();
+
+public:
+    CBlockIndexPool() : nUsed(0), nSize(0) {}
+    ~CBlockIndexPool() { Clear(); }
+    CBlockIndexPool(const CBlockIndexPool &) = delete;
+    CBlockIndexPool &operator=(const CBlockIndexPool &) = delete;
+
+    CBlockIndex *Allocate();
+    CBlockIndex *Allocate(const CBlockHeader &block);
+    //! Have the next nCount entries come from a single chunk
+    void Reserve(size_t nCount);
+    //! Destroy all entries
+    void Clear();
+
+    size_t size() const { return nSize; }
+    size_t DynamicMemoryUsage() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -8,6 +8,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -18,6 +21,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** The default maximum number of worker deques in a check queue, the master uses one extra. */
+static const unsigned int DEFAULT_CHECKQUEUE_WORKERS = 64;
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -27,12 +33,27 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker (and the master) owns a deque of checks. The master spreads
+  * each batch it adds over all the deques in bulk. A worker takes work from
+  * the back of its own deque and, when that runs dry, steals half of the
+  * checks from the front of another worker's deque. Each deque has its own
+  * lock which is only contended when a steal happens, so the workers do not
+  * serialize on a single queue lock. The shared mutex is only used to put
+  * idle threads to sleep and wake them up again.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    /** A worker's own deque of pending checks. */
+    struct CWorkerDeque
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Mutex used for sleeping and waking up idle threads, and for worker registration
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -41,25 +62,27 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per worker deques. Index 0 belongs to the master. The size never changes after construction.
+    std::vector<std::unique_ptr<CWorkerDeque> > vDeques;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that have registered, not including the master.
+    unsigned int nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Whether the master has joined the pool in Wait()
+    bool fMasterActive;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications that are still sitting in one of the deques.
+    std::atomic<unsigned int> nQueued;
 
     //! Whether we're shutting down.
     std::atomic<bool> fQuit;
@@ -67,90 +90,137 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The deque that will receive the next batch of checks
+    std::atomic<unsigned int> nNextDeque;
+
+    //! Statistics for the current validation session.
+    std::atomic<uint64_t> nSteals;
+    std::atomic<unsigned int> nMaxDepth;
+
+    //! Statistics of the last completed validation session.
+    uint64_t nLastSteals;
+    unsigned int nLastMaxDepth;
+
+    /** Move up to one batch of checks from the back of our own deque into vChecks. */
+    bool TakeOwn(CWorkerDeque &wd, std::vector<T> &vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(wd.mutex);
+        if (wd.checks.empty())
+            return false;
+        unsigned int nNow = std::min(nBatchSize, (unsigned int)wd.checks.size());
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++)
+        {
+            vChecks[i].swap(wd.checks.back());
+            wd.checks.pop_back();
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Steal half of the checks, but at most one batch, from the front of a victim's deque. */
+    bool Steal(CWorkerDeque &wd, std::vector<T> &vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(wd.mutex, boost::try_to_lock);
+        if (!lock.owns_lock() || wd.checks.empty())
+            return false;
+        unsigned int nNow =
+            std::max(1U, std::min(nBatchSize, (unsigned int)(wd.checks.size() + 1) / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++)
+        {
+            vChecks[i].swap(wd.checks.front());
+            wd.checks.pop_front();
+        }
+        nQueued -= nNow;
+        nSteals++;
+        return true;
+    }
+
+    /** Get the next batch of work for the worker owning deque nSelf, stealing if necessary. */
+    bool GetWork(unsigned int nSelf, std::vector<T> &vChecks)
+    {
+        if (TakeOwn(*vDeques[nSelf], vChecks))
+            return true;
+        for (unsigned int i = 1; i < vDeques.size() && nQueued > 0; i++)
+        {
+            if (Steal(*vDeques[(nSelf + i) % vDeques.size()], vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable &cond = fMaster ? condMaster : condWorker;
+        unsigned int nSelf = 0;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster)
+                fMasterActive = true;
+            else
+                nSelf = 1 + (nWorkers++ % (vDeques.size() - 1));
+        }
+
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do
+        while (true)
         {
+            if (!GetWork(nSelf, vChecks))
             {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow)
+                if (fMaster)
                 {
-                    fAllOk &= fOk;
-                    if (nTodo >= nNow)
-                        nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
+                    // Wait until every check has been executed, or new work shows up that we can help with.
+                    while (nTodo > 0 && nQueued == 0)
+                        condMaster.wait(lock);
+                    if (nTodo == 0)
                     {
-                        // We processed the last element; inform the master it can exit and return the result
-                        queue.clear();
-                        condMaster.notify_one();
-                    }
-                    if (fQuit && !fMaster)
-                    {
-                        nTodo = 0;
-                        queue.clear();
-                        condMaster.notify_one();
-                    }
-                }
-                else
-                {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty())
-                {
-                    if ((fMaster) && nTodo == 0)
-                    {
-                        nTotal--;
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
+                        fAllOk = true;
                         fQuit = false; // reset the flag before returning
+                        fMasterActive = false;
+                        nLastSteals = nSteals.exchange(0);
+                        nLastMaxDepth = nMaxDepth.exchange(0);
                         return fRet;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++)
+                else
                 {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                    while (nQueued == 0)
+                        condWorker.wait(lock);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
-            BOOST_FOREACH (T &check, vChecks)
+
+            // execute work, skipping it if a check has already failed or we were told to quit
+            bool fOk = fAllOk && !fQuit;
+            for (T &check : vChecks)
                 if (fOk)
                     fOk = check();
+            if (!fOk && !fQuit)
+                fAllOk = false;
+            unsigned int nNow = vChecks.size();
             vChecks.clear();
-        } while (true);
+
+            if (nTodo.fetch_sub(nNow) == nNow)
+            {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+        }
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn)
-        : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn)
+    //! Create a new check queue with room for up to nMaxWorkers worker threads
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers = DEFAULT_CHECKQUEUE_WORKERS)
+        : nWorkers(0), fMasterActive(false), fAllOk(true), nTodo(0), nQueued(0), fQuit(false),
+          nBatchSize(nBatchSizeIn), nNextDeque(0), nSteals(0), nMaxDepth(0), nLastSteals(0), nLastMaxDepth(0)
     {
+        for (unsigned int i = 0; i < std::max(1U, nMaxWorkers) + 1; i++)
+            vDeques.emplace_back(new CWorkerDeque());
     }
 
     //! Worker thread
@@ -162,16 +232,37 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T &check, vChecks)
+        if (vChecks.empty())
+            return;
+
+        // Count the work before it becomes visible to the workers so nTodo can never underflow.
+        nTodo += vChecks.size();
+
+        // Spread the checks over the worker deques, at most one batch per deque, taking each deque lock only once.
+        unsigned int nDeques = vDeques.size();
+        unsigned int nChunk = std::max(1U, std::min(nBatchSize, (unsigned int)vChecks.size() / nDeques));
+        for (unsigned int nStart = 0; nStart < vChecks.size(); nStart += nChunk)
         {
-            queue.push_back(T());
-            check.swap(queue.back());
+            unsigned int nEnd = std::min((unsigned int)vChecks.size(), nStart + nChunk);
+            CWorkerDeque &wd = *vDeques[nNextDeque++ % nDeques];
+            boost::unique_lock<boost::mutex> lock(wd.mutex);
+            for (unsigned int i = nStart; i < nEnd; i++)
+            {
+                wd.checks.push_back(T());
+                vChecks[i].swap(wd.checks.back());
+            }
+            // Update while holding the deque lock so that takers from this deque never see nQueued underflow.
+            nQueued += nEnd - nStart;
         }
-        nTodo += vChecks.size();
+
+        unsigned int nDepth = nQueued;
+        if (nDepth > nMaxDepth)
+            nMaxDepth = nDepth;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -179,8 +270,15 @@ public:
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (!fMasterActive && nTodo == 0 && fAllOk == true);
     }
+
+    //! The number of checks that are currently waiting to be executed
+    unsigned int QueueDepth() { return nQueued; }
+    //! The number of steals during the last completed Wait()
+    uint64_t GetLastSteals() { return nLastSteals; }
+    //! The largest queue depth seen during the last completed Wait()
+    unsigned int GetLastMaxDepth() { return nLastMaxDepth; }
 };
 
 /**
@@ -8,6 +8,7 @@
 #include "consensus/consensus.h"
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 #include "util.h"
 
 #include <assert.h>
@@ -15,7 +16,11 @@
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage)
+bool CCoinsView::GetCommitment(CUTXOCommitment &commitment) const { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
+    const uint256 &hashBlock,
+    const CUTXOCommitment *pcommitment,
+    size_t &nChildCachedCoinsUsage)
 {
     return false;
 }
@@ -24,19 +29,63 @@ CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) {}
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
+bool CCoinsViewBacked::GetCommitment(CUTXOCommitment &commitment) const { return base->GetCommitment(commitment); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage)
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
+    const uint256 &hashBlock,
+    const CUTXOCommitment *pcommitment,
+    size_t &nChildCachedCoinsUsage)
 {
-    return base->BatchWrite(mapCoins, hashBlock, nChildCachedCoinsUsage);
+    return base->BatchWrite(mapCoins, hashBlock, pcommitment, nChildCachedCoinsUsage);
 }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
+/** The bytes a coin is hashed into the commitment as */
+static void CommitmentElement(CDataStream &ss, const COutPoint &outpoint, const Coin &coin)
+{
+    ss << outpoint;
+    ss << (uint32_t)(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+}
+
+void CUTXOCommitment::Add(const COutPoint &outpoint, const Coin &coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    CommitmentElement(ss, outpoint, coin);
+    muhash.Insert((const unsigned char *)ss.data(), ss.size());
+    nTransactionOutputs++;
+    nTotalAmount += coin.out.nValue;
+    nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+}
+
+void CUTXOCommitment::Remove(const COutPoint &outpoint, const Coin &coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    CommitmentElement(ss, outpoint, coin);
+    muhash.Remove((const unsigned char *)ss.data(), ss.size());
+    nTransactionOutputs--;
+    nTotalAmount -= coin.out.nValue;
+    nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+}
+
+CUTXOCommitment &CUTXOCommitment::operator+=(const CUTXOCommitment &other)
+{
+    muhash *= other.muhash;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nTotalAmount += other.nTotalAmount;
+    nBogoSize += other.nBogoSize;
+    return *this;
+}
+
 SaltedOutpointHasher::SaltedOutpointHasher()
     : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
 {
 }
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn)
+    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), fCommitmentFetched(false), fHaveCommitment(false)
+{
+}
 size_t CCoinsViewCache::DynamicMemoryUsage() const
 {
     LOCK(cs_utxo);
@@ -119,6 +168,8 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin &&coin, bool possi
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    fCommitmentFetched = true;
+    fHaveCommitment = false;
 }
 
 void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight)
@@ -139,6 +190,8 @@ void CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin *moveout)
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end())
         return;
+    fCommitmentFetched = true;
+    fHaveCommitment = false;
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     if (moveout)
     {
@@ -185,6 +238,29 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const
     return it != cacheCoins.end();
 }
 
+void CCoinsViewCache::PrefetchCoin(const COutPoint &outpoint) const
+{
+    if (HaveCoinInCache(outpoint))
+        return;
+
+    Coin tmp;
+    if (!base->GetCoin(outpoint, tmp))
+        return;
+
+    LOCK(cs_utxo);
+    // Another thread may have loaded or modified this entry while we were reading, in which case
+    // the cached version takes precedence.
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.emplace(
+        std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp)));
+    if (!inserted)
+        return;
+    if (it->second.coin.IsSpent())
+        it->second.flags = CCoinsCacheEntry::FRESH;
+    cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const
 {
     LOCK(cs_utxo);
@@ -199,7 +275,31 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn)
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, size_t &nChildCachedCoinsUsage)
+bool CCoinsViewCache::GetCommitment(CUTXOCommitment &commitmentOut) const
+{
+    LOCK(cs_utxo);
+    if (!fCommitmentFetched)
+    {
+        fHaveCommitment = base->GetCommitment(commitment);
+        fCommitmentFetched = true;
+    }
+    if (fHaveCommitment)
+        commitmentOut = commitment;
+    return fHaveCommitment;
+}
+
+void CCoinsViewCache::SetCommitment(const CUTXOCommitment &commitmentIn)
+{
+    LOCK(cs_utxo);
+    commitment = commitmentIn;
+    fCommitmentFetched = true;
+    fHaveCommitment = true;
+}
+
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
+    const uint256 &hashBlockIn,
+    const CUTXOCommitment *pcommitment,
+    size_t &nChildCachedCoinsUsage)
 {
     LOCK(cs_utxo);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
@@ -265,13 +365,19 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             it++;
     }
     hashBlock = hashBlockIn;
+    fCommitmentFetched = true;
+    fHaveCommitment = (pcommitment != nullptr);
+    if (fHaveCommitment)
+        commitment = *pcommitment;
     return true;
 }
 
 bool CCoinsViewCache::Flush()
 {
     LOCK(cs_utxo);
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock, cachedCoinsUsage);
+    CUTXOCommitment commitmentFlushed;
+    bool fCommitment = GetCommitment(commitmentFlushed);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, fCommitment ? &commitmentFlushed : nullptr, cachedCoinsUsage);
     return fOk;
 }
 
@@ -9,8 +9,10 @@
 
 #include "compressor.h"
 #include "core_memusage.h"
+#include "flatmap.h"
 #include "hash.h"
 #include "memusage.h"
+#include "muhash.h"
 #include "serialize.h"
 #include "sync.h"
 #include "uint256.h"
@@ -22,8 +24,6 @@
 #include <boost/thread/locks.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
-#include <unordered_map>
-
 struct CCoinsStats
 {
     int nHeight;
@@ -102,6 +102,45 @@ public:
     size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(out.scriptPubKey); }
 };
 
+/**
+ * A summary of the UTXO set that is kept up to date as blocks are connected and disconnected, so that it
+ * can be had without going through the whole set.  The hash covers the outpoint, height, coinbase flag
+ * and output of every coin, and does not depend on the order the coins were added in.
+ */
+class CUTXOCommitment
+{
+public:
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    //! Approximate serialized size of the set, see GetBogoSize()
+    uint64_t nBogoSize;
+
+    CUTXOCommitment() : nTransactionOutputs(0), nTotalAmount(0), nBogoSize(0) {}
+    void Add(const COutPoint &outpoint, const Coin &coin);
+    void Remove(const COutPoint &outpoint, const Coin &coin);
+    //! Add in the commitment of a disjoint set of coins
+    CUTXOCommitment &operator+=(const CUTXOCommitment &other);
+
+    //! The size a coin is counted with in nBogoSize, which is independent of the database format
+    static uint64_t GetBogoSize(const CScript &scriptPubKey)
+    {
+        return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+               2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(muhash);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(nBogoSize);
+    }
+};
+
 class SaltedOutpointHasher
 {
 private:
@@ -134,7 +173,11 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin &&coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The coins cache. The entries are kept in an arena rather than in a heap allocation each, which together with the
+ * inline storage of short scripts in CScript means that most coins in the cache cost no allocation of their own.
+ */
+typedef CFlatHashMap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -173,9 +216,16 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
+    //! Retrieve the summary of the coins as of GetBestBlock(), false if it is not known
+    virtual bool GetCommitment(CUTXOCommitment &commitment) const;
+
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage);
+    //! The passed mapCoins can be modified.  pcommitment summarizes the coins as of hashBlock, and is
+    //! NULL when that is not known.
+    virtual bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -198,8 +248,12 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
+    bool GetCommitment(CUTXOCommitment &commitment) const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage) override;
+    bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -219,6 +273,14 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /**
+     * Summary of the coins as of hashBlock, taken from the base on first use.  Adding or spending coins
+     * makes it unknown until the caller, who knows what the changes were, sets the updated one.
+     */
+    mutable CUTXOCommitment commitment;
+    mutable bool fCommitmentFetched;
+    mutable bool fHaveCommitment;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -227,7 +289,12 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage);
+    bool GetCommitment(CUTXOCommitment &commitment) const;
+    void SetCommitment(const CUTXOCommitment &commitment);
+    bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage);
 
     /**
      * Check if we have the given utxo already loaded in this cache.
@@ -236,6 +303,14 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Load the given coin from the backing view into this cache if it is not cached yet.
+     * Unlike the other accessors the backing view is read without holding cs_utxo, so that
+     * several threads can warm the cache at the same time. The backing view must therefore be
+     * safe to read concurrently, and must not be written to until prefetching has finished.
+     */
+    void PrefetchCoin(const COutPoint &outpoint) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin. Modifications to other cache entries are
@@ -1,7 +1,10 @@
 #include "merkle.h"
 #include "hash.h"
+#include "crypto/sha256.h"
 #include "utilstrencodings.h"
 
+#include <assert.h>
+
 /*     WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
        that the following merkle tree algorithm has a serious flaw related to
@@ -126,10 +129,27 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
+/* Computes the root one level at a time, so that all pairs of a level are double-SHA256'd in a
+   single SHA256D64 call which can hash several of them at once on CPUs with SSE4.1 or AVX2. */
 uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+    bool mutation = false;
+    std::vector<uint256> hashes(leaves);
+    while (hashes.size() > 1) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+                if (hashes[pos] == hashes[pos + 1]) mutation = true;
+            }
+        }
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        // The pairs are adjacent in memory, and each result overwrites the first half of the level.
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (mutated) *mutated = mutation;
+    if (hashes.size() == 0) return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
@@ -138,6 +158,30 @@ std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uin
     return ret;
 }
 
+uint256 ComputeMerkleSubtree(const uint256* leaves, size_t count, unsigned int height, bool* mutated,
+    uint32_t position, std::vector<uint256>* pbranch) {
+    assert(count > 0 && count <= ((uint64_t)1) << height);
+    std::vector<uint256> subtree(leaves, leaves + count);
+    uint256 hash = ComputeMerkleRoot(subtree, mutated);
+    if (pbranch && position < count) {
+        std::vector<uint256> branch = ComputeMerkleBranch(subtree, position);
+        pbranch->insert(pbranch->end(), branch.begin(), branch.end());
+    }
+    // Raise a partial subtree to the requested height. It is the last node of each of these levels, so it is
+    // its own sibling, and as it has no pair of its own it can not take part in a mutation either.
+    unsigned int level = 0;
+    while ((((uint64_t)1) << level) < count) {
+        level++;
+    }
+    for (; level < height; level++) {
+        if (pbranch && position < count) {
+            pbranch->push_back(hash);
+        }
+        hash = Hash(hash.begin(), hash.end(), hash.begin(), hash.end());
+    }
+    return hash;
+}
+
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& vMerkleBranch, uint32_t nIndex) {
     uint256 hash = leaf;
     for (std::vector<uint256>::const_iterator it = vMerkleBranch.begin(); it != vMerkleBranch.end(); ++it) {
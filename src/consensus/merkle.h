@@ -17,6 +17,18 @@ uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NU
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
+/*
+ * Compute the node `height` levels above the leaves that covers the count leaves starting at leaves,
+ * which must be the first leaf of a subtree of that height. A subtree at the right edge of the tree can
+ * have fewer than 2^height leaves, in which case its root is hashed with itself up to that height just
+ * like in the full tree. Computing the subtrees of a tree separately and then the tree over their roots
+ * gives the same result as ComputeMerkleRoot(), including *mutated which is set if a duplicated subtree
+ * was found within the range.
+ * If pbranch is given, the branch for leaf number position within the range is appended to it.
+ */
+uint256 ComputeMerkleSubtree(const uint256* leaves, size_t count, unsigned int height, bool* mutated,
+    uint32_t position = -1, std::vector<uint256>* pbranch = NULL);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
@@ -20,6 +20,26 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 #endif
 #endif
 
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -175,21 +195,126 @@ bool SelfTest(TransformType tr) {
 
 TransformType Transform = sha256::Transform;
 
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Double-SHA256 of a single 64 byte input, using the selected one block transform. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buf[64] = {0};
+
+    // The input fills the first block entirely, so the second one only holds the padding.
+    sha256::Initialize(s);
+    Transform(s, in, 1);
+    buf[0] = 0x80;
+    WriteBE64(buf + 56, 512);
+    Transform(s, buf, 1);
+
+    // Hash the 32 byte result again, which fits in a single padded block.
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(buf + 4 * i, s[i]);
+    }
+    buf[32] = 0x80;
+    WriteBE64(buf + 56, 256);
+    sha256::Initialize(s);
+    Transform(s, buf, 1);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(out + 4 * i, s[i]);
+    }
+}
+
+/** Check a multi-lane double-SHA256 implementation against the single lane one. */
+bool SelfTestD64(TransformD64Type tr, size_t lanes)
+{
+    unsigned char in[64 * 8];
+    unsigned char expected[32 * 8];
+    unsigned char out[32 * 8];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (unsigned char)(i * 7 + 13);
+    }
+    for (size_t i = 0; i < lanes; i++) {
+        TransformD64(expected + 32 * i, in + 64 * i);
+    }
+    tr(out, in);
+    if (memcmp(out, expected, 32 * lanes)) return false;
+    // Hashing in place must give the same result, it is how the merkle tree code uses it.
+    tr(in, in);
+    return memcmp(in, expected, 32 * lanes) == 0;
+}
+
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+/** Whether the OS saves the AVX registers on a context switch. */
+bool AVXEnabled()
+{
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    return (xcr0_lo & 6) == 6;
+}
+#endif
+
 } // namespace
 
-std::string SHA256AutoDetect()
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation)
 {
+    std::string ret = "standard";
+    Transform = sha256::Transform;
+    TransformD64_2way = nullptr;
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
+
 #if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    bool have_sse4 = false;
+    bool have_avx2 = false;
+    bool have_shani = false;
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        bool have_avx = (ecx >> 27) & 1 && (ecx >> 28) & 1 && AVXEnabled();
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = have_avx && (ebx >> 5) & 1;
+            have_shani = have_sse4 && (ebx >> 29) & 1;
+        }
+    }
+    have_sse4 &= (use_implementation & sha256_implementation::USE_SSE4) != 0;
+    have_avx2 &= (use_implementation & sha256_implementation::USE_AVX2) != 0;
+    have_shani &= (use_implementation & sha256_implementation::USE_SHANI) != 0;
+
+    if (have_shani) {
+#if defined(ENABLE_SHANI)
+        // The SHA extensions outperform the vectorized implementations, so they are not used alongside them.
+        Transform = sha256_shani::Transform;
+        TransformD64_2way = sha256d64_shani::Transform_2way;
+        ret = "shani(1way,2way)";
+        have_sse4 = false;
+        have_avx2 = false;
+#endif
+    }
+    if (have_sse4) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        ret = "sse4";
+#if defined(ENABLE_SSE41)
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+#endif
     }
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
 #endif
 
     assert(SelfTest(Transform));
-    return "standard";
+    assert(!TransformD64_2way || SelfTestD64(TransformD64_2way, 2));
+    assert(!TransformD64_4way || SelfTestD64(TransformD64_4way, 4));
+    assert(!TransformD64_8way || SelfTestD64(TransformD64_8way, 8));
+    return ret;
 }
 
 ////// SHA-256
@@ -248,3 +373,37 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -28,9 +28,33 @@ public:
     size_t GetNumBytesHashed() const { return bytes; }
 };
 
-/** Autodetect the best available SHA256 implementation.
+namespace sha256_implementation
+{
+/** The optional implementations SHA256AutoDetect may pick from. */
+enum UseImplementation : uint8_t
+{
+    STANDARD = 0,
+    USE_SSE4 = 1 << 0, //!< the SSE4 transform and the SSE4.1 4-way double-SHA256
+    USE_AVX2 = 1 << 1, //!< the AVX2 8-way double-SHA256
+    USE_SHANI = 1 << 2, //!< the SHA extensions transform and 2-way double-SHA256
+    USE_ALL = USE_SSE4 | USE_AVX2 | USE_SHANI,
+};
+}
+
+/** Autodetect the best available SHA256 implementation, only considering the ones in use_implementation.
+ *  Can be called again to switch implementations, e.g. to benchmark each of them, as long as no other
+ *  thread is hashing at the time.
  *  Returns the name of the implementation.
  */
-std::string SHA256AutoDetect();
+std::string SHA256AutoDetect(
+    sha256_implementation::UseImplementation use_implementation = sha256_implementation::USE_ALL);
+
+/** Compute the double-SHA256 of a number of consecutive 64 byte blobs at once.
+ *  Uses the multi-lane SSE4.1/AVX2/SHA-NI implementations when SHA256AutoDetect found them.
+ *  output: pointer to a blocks*32 byte output buffer, which may be the same as input
+ *  input:  pointer to a blocks*64 byte input buffer
+ *  blocks: the number of hashes to compute
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
 #endif // BITCOIN_CRYPTO_SHA256_H
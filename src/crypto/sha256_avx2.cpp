@@ -0,0 +1,137 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// An 8-way AVX2 implementation of double-SHA256 over 64 byte inputs. Every
+// 32 bit lane of a vector register holds the state of an independent hash,
+// so eight inputs are hashed with the instruction count of a single one.
+
+#ifdef ENABLE_AVX2
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_avx2
+{
+namespace
+{
+const uint32_t K[64] = {0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul,
+    0x923f82a4ul, 0xab1c5ed5ul, 0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul,
+    0x9bdc06a7ul, 0xc19bf174ul, 0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul,
+    0x5cb0a9dcul, 0x76f988daul, 0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul,
+    0x06ca6351ul, 0x14292967ul, 0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul,
+    0x81c2c92eul, 0x92722c85ul, 0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul,
+    0xf40e3585ul, 0x106aa070ul, 0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul,
+    0x5b9cca4ful, 0x682e6ff3ul, 0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul,
+    0xbef9a3f7ul, 0xc67178f2ul};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul,
+    0x1f83d9abul, 0x5be0cd19ul};
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+__m256i inline RotR(__m256i x, int n) { return Or(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(Xor(RotR(x, 2), RotR(x, 13)), RotR(x, 22)); }
+__m256i inline Sigma1(__m256i x) { return Xor(Xor(RotR(x, 6), RotR(x, 11)), RotR(x, 25)); }
+__m256i inline sigma0(__m256i x) { return Xor(Xor(RotR(x, 7), RotR(x, 18)), ShR(x, 3)); }
+__m256i inline sigma1(__m256i x) { return Xor(Xor(RotR(x, 17), RotR(x, 19)), ShR(x, 10)); }
+
+/** One round of SHA-256 on all lanes, k already includes the message word. */
+void inline Round(__m256i a, __m256i b, __m256i c, __m256i &d, __m256i e, __m256i f, __m256i g, __m256i &h, __m256i k)
+{
+    __m256i t1 = Add(Add(h, Sigma1(e)), Add(Ch(e, f, g), k));
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Run the compression function on one block per lane. */
+void Transform(__m256i *s, const __m256i *in)
+{
+    __m256i w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = in[i];
+    for (int i = 16; i < 64; i++)
+        w[i] = Add(Add(sigma1(w[i - 2]), w[i - 7]), Add(sigma0(w[i - 15]), w[i - 16]));
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8)
+    {
+        Round(a, b, c, d, e, f, g, h, Add(_mm256_set1_epi32(K[i]), w[i]));
+        Round(h, a, b, c, d, e, f, g, Add(_mm256_set1_epi32(K[i + 1]), w[i + 1]));
+        Round(g, h, a, b, c, d, e, f, Add(_mm256_set1_epi32(K[i + 2]), w[i + 2]));
+        Round(f, g, h, a, b, c, d, e, Add(_mm256_set1_epi32(K[i + 3]), w[i + 3]));
+        Round(e, f, g, h, a, b, c, d, Add(_mm256_set1_epi32(K[i + 4]), w[i + 4]));
+        Round(d, e, f, g, h, a, b, c, Add(_mm256_set1_epi32(K[i + 5]), w[i + 5]));
+        Round(c, d, e, f, g, h, a, b, Add(_mm256_set1_epi32(K[i + 6]), w[i + 6]));
+        Round(b, c, d, e, f, g, h, a, Add(_mm256_set1_epi32(K[i + 7]), w[i + 7]));
+    }
+
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+void inline Initialize(__m256i *s)
+{
+    for (int i = 0; i < 8; i++)
+        s[i] = _mm256_set1_epi32(INIT[i]);
+}
+} // namespace
+
+/** Compute the double-SHA256 of eight consecutive 64 byte inputs. out may alias in. */
+void Transform_8way(unsigned char *out, const unsigned char *in)
+{
+    __m256i s[8], w[16];
+
+    // First hash: the 64 byte input followed by a block holding only the padding.
+    Initialize(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = _mm256_set_epi32(ReadBE32(in + 448 + 4 * i), ReadBE32(in + 384 + 4 * i), ReadBE32(in + 320 + 4 * i),
+            ReadBE32(in + 256 + 4 * i), ReadBE32(in + 192 + 4 * i), ReadBE32(in + 128 + 4 * i),
+            ReadBE32(in + 64 + 4 * i), ReadBE32(in + 4 * i));
+    Transform(s, w);
+    w[0] = _mm256_set1_epi32(0x80000000ul);
+    for (int i = 1; i < 15; i++)
+        w[i] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32(512);
+    Transform(s, w);
+
+    // Second hash: the 32 byte result of the first one, padded to a single block.
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = _mm256_set1_epi32(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32(256);
+    Initialize(s);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+    {
+        WriteBE32(out + 4 * i, _mm256_extract_epi32(s[i], 0));
+        WriteBE32(out + 32 + 4 * i, _mm256_extract_epi32(s[i], 1));
+        WriteBE32(out + 64 + 4 * i, _mm256_extract_epi32(s[i], 2));
+        WriteBE32(out + 96 + 4 * i, _mm256_extract_epi32(s[i], 3));
+        WriteBE32(out + 128 + 4 * i, _mm256_extract_epi32(s[i], 4));
+        WriteBE32(out + 160 + 4 * i, _mm256_extract_epi32(s[i], 5));
+        WriteBE32(out + 192 + 4 * i, _mm256_extract_epi32(s[i], 6));
+        WriteBE32(out + 224 + 4 * i, _mm256_extract_epi32(s[i], 7));
+    }
+}
+} // namespace sha256d64_avx2
+
+#endif
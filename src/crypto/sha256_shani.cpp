@@ -0,0 +1,258 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA256 using the Intel/AMD SHA extensions. The sha256rnds2 instruction does
+// two rounds at a time on a state kept as the word pairs ABEF and CDGH, and
+// sha256msg1/sha256msg2 compute the message schedule four words at a time.
+
+#ifdef ENABLE_SHANI
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace
+{
+alignas(16) const uint32_t K[64] = {0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul,
+    0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul, 0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul,
+    0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul, 0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful,
+    0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul, 0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul,
+    0xd5a79147ul, 0x06ca6351ul, 0x14292967ul, 0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul,
+    0x766a0abbul, 0x81c2c92eul, 0x92722c85ul, 0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul,
+    0xd6990624ul, 0xf40e3585ul, 0x106aa070ul, 0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul,
+    0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul, 0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul,
+    0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul};
+
+//! The initial state, already in ABEF/CDGH order.
+alignas(16) const uint32_t INIT0[4] = {0x9b05688cul, 0x510e527ful, 0xbb67ae85ul, 0x6a09e667ul};
+alignas(16) const uint32_t INIT1[4] = {0x5be0cd19ul, 0x1f83d9abul, 0xa54ff53aul, 0x3c6ef372ul};
+
+//! Byte shuffle that converts four big endian words to native ones and back.
+alignas(16) const uint8_t MASK[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+
+/** Four rounds, using message words m and round constants K[4*i..4*i+3]. */
+void inline __attribute__((always_inline)) QuadRound(__m128i &s0, __m128i &s1, __m128i m, int i)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i *)(K + 4 * i)));
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** First half of the message schedule: add sigma0 of the following words to m0. */
+void inline __attribute__((always_inline)) ShiftMessageA(__m128i &m0, __m128i m1) { m0 = _mm_sha256msg1_epu32(m0, m1); }
+/** Second half of the message schedule: finish the next four words in m2. */
+void inline __attribute__((always_inline)) ShiftMessageC(__m128i m0, __m128i m1, __m128i &m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+void inline __attribute__((always_inline)) ShiftMessageB(__m128i &m0, __m128i m1, __m128i &m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/** Convert a state in ABCD/EFGH order to the ABEF/CDGH order the instructions use. */
+void inline __attribute__((always_inline)) Shuffle(__m128i &s0, __m128i &s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** The inverse of Shuffle(). */
+void inline __attribute__((always_inline)) Unshuffle(__m128i &s0, __m128i &s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i inline __attribute__((always_inline)) Load(const unsigned char *in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), _mm_load_si128((const __m128i *)MASK));
+}
+
+void inline __attribute__((always_inline)) Save(unsigned char *out, __m128i s)
+{
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(s, _mm_load_si128((const __m128i *)MASK)));
+}
+
+/** Run the compression function on one block, given as four vectors of native endian message words. */
+void inline __attribute__((always_inline)) Compress(__m128i &s0, __m128i &s1, __m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    const __m128i so0 = s0, so1 = s1;
+
+    QuadRound(s0, s1, m0, 0);
+    QuadRound(s0, s1, m1, 1);
+    ShiftMessageA(m0, m1);
+    QuadRound(s0, s1, m2, 2);
+    ShiftMessageA(m1, m2);
+    QuadRound(s0, s1, m3, 3);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 4);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 5);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 6);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 7);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 8);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 9);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 10);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 11);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 12);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 13);
+    ShiftMessageC(m0, m1, m2);
+    QuadRound(s0, s1, m2, 14);
+    ShiftMessageC(m1, m2, m3);
+    QuadRound(s0, s1, m3, 15);
+
+    s0 = _mm_add_epi32(s0, so0);
+    s1 = _mm_add_epi32(s1, so1);
+}
+
+/**
+ * Compress(), for two independent states at once. sha256rnds2 has a long latency compared to its
+ * throughput, so interleaving two hashes keeps the SHA unit busy while either one waits on its result.
+ */
+void inline __attribute__((always_inline)) Compress2(__m128i &as0, __m128i &as1, __m128i am0, __m128i am1, __m128i am2,
+    __m128i am3, __m128i &bs0, __m128i &bs1, __m128i bm0, __m128i bm1, __m128i bm2, __m128i bm3)
+{
+    const __m128i aso0 = as0, aso1 = as1, bso0 = bs0, bso1 = bs1;
+
+    QuadRound(as0, as1, am0, 0);
+    QuadRound(bs0, bs1, bm0, 0);
+    QuadRound(as0, as1, am1, 1);
+    QuadRound(bs0, bs1, bm1, 1);
+    ShiftMessageA(am0, am1);
+    ShiftMessageA(bm0, bm1);
+    QuadRound(as0, as1, am2, 2);
+    QuadRound(bs0, bs1, bm2, 2);
+    ShiftMessageA(am1, am2);
+    ShiftMessageA(bm1, bm2);
+    QuadRound(as0, as1, am3, 3);
+    QuadRound(bs0, bs1, bm3, 3);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 4);
+    QuadRound(bs0, bs1, bm0, 4);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 5);
+    QuadRound(bs0, bs1, bm1, 5);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 6);
+    QuadRound(bs0, bs1, bm2, 6);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 7);
+    QuadRound(bs0, bs1, bm3, 7);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 8);
+    QuadRound(bs0, bs1, bm0, 8);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 9);
+    QuadRound(bs0, bs1, bm1, 9);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 10);
+    QuadRound(bs0, bs1, bm2, 10);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 11);
+    QuadRound(bs0, bs1, bm3, 11);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 12);
+    QuadRound(bs0, bs1, bm0, 12);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 13);
+    QuadRound(bs0, bs1, bm1, 13);
+    ShiftMessageC(am0, am1, am2);
+    ShiftMessageC(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 14);
+    QuadRound(bs0, bs1, bm2, 14);
+    ShiftMessageC(am1, am2, am3);
+    ShiftMessageC(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 15);
+    QuadRound(bs0, bs1, bm3, 15);
+
+    as0 = _mm_add_epi32(as0, aso0);
+    as1 = _mm_add_epi32(as1, aso1);
+    bs0 = _mm_add_epi32(bs0, bso0);
+    bs1 = _mm_add_epi32(bs1, bso1);
+}
+} // namespace
+
+namespace sha256_shani
+{
+void Transform(uint32_t *s, const unsigned char *chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--)
+    {
+        Compress(s0, s1, Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48));
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i *)s, s0);
+    _mm_storeu_si128((__m128i *)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani
+{
+/** Compute the double-SHA256 of two consecutive 64 byte inputs. out may alias in. */
+void Transform_2way(unsigned char *out, const unsigned char *in)
+{
+    const __m128i init0 = _mm_load_si128((const __m128i *)INIT0);
+    const __m128i init1 = _mm_load_si128((const __m128i *)INIT1);
+    const __m128i zero = _mm_setzero_si128();
+
+    // First hash: the 64 byte input followed by a block holding only the padding.
+    __m128i as0 = init0, as1 = init1, bs0 = init0, bs1 = init1;
+    Compress2(as0, as1, Load(in), Load(in + 16), Load(in + 32), Load(in + 48), bs0, bs1, Load(in + 64),
+        Load(in + 80), Load(in + 96), Load(in + 112));
+    const __m128i pad0 = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+    const __m128i pad3 = _mm_set_epi32(512, 0, 0, 0);
+    Compress2(as0, as1, pad0, zero, zero, pad3, bs0, bs1, pad0, zero, zero, pad3);
+
+    // Second hash: the 32 byte result of the first one, padded to a single block.
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    const __m128i pad2 = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+    const __m128i pad3b = _mm_set_epi32(256, 0, 0, 0);
+    __m128i am0 = as0, am1 = as1, bm0 = bs0, bm1 = bs1;
+    as0 = init0;
+    as1 = init1;
+    bs0 = init0;
+    bs1 = init1;
+    Compress2(as0, as1, am0, am1, pad2, pad3b, bs0, bs1, bm0, bm1, pad2, pad3b);
+
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    Save(out, as0);
+    Save(out + 16, as1);
+    Save(out + 32, bs0);
+    Save(out + 48, bs1);
+}
+} // namespace sha256d64_shani
+
+#endif
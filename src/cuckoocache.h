@@ -0,0 +1,275 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "crypto/common.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+
+/**
+ * A fixed size set of salted 256 bit hashes, such as the entries of the signature cache.
+ *
+ * The set is a cuckoo hash table: every entry can live in one of HASH_COUNT slots that are derived from
+ * its own bits, so a lookup reads at most HASH_COUNT slots and never takes a lock. Each slot is 32 bytes,
+ * two to a cache line, and holds the first 192 bits of the entry along with a word of metadata. As the
+ * entries are salted hashes an attacker can not produce two that agree on those bits.
+ *
+ * Slots are written with a sequence lock: the version in the metadata is odd while a slot is being written,
+ * and a reader that sees the version change while it reads a slot treats it as a miss. Writers are
+ * serialized by a mutex. A spurious miss only means that a signature is checked again, so readers never
+ * have to retry.
+ *
+ * Entries are not removed. Contains() can instead mark an entry as erased, which lets a later Insert()
+ * reuse its slot. Entries also age out by generation: once as many entries have been inserted as fit
+ * in GENERATION_PERCENT of the table, all entries that were inserted before the previous generation are
+ * marked as erased. When an insert can not find a free slot it moves existing entries to one of their
+ * other slots, and if that doesn't free one up within a bounded number of moves the last entry that was
+ * moved is evicted.
+ */
+class CCuckooCache
+{
+public:
+    struct Stats
+    {
+        uint64_t nHits;
+        uint64_t nMisses;
+        uint64_t nInserts;
+        uint64_t nEvictions;
+    };
+
+private:
+    static const unsigned int HASH_COUNT = 4;
+    static const unsigned int GENERATION_PERCENT = 45;
+    static const unsigned int STAT_STRIPES = 16;
+
+    // Flags in the low byte of a slot's metadata, the rest of it is the version of the sequence lock
+    static const uint64_t SLOT_OCCUPIED = 1;
+    static const uint64_t SLOT_ERASED = 2;
+    static const uint64_t SLOT_GENERATION = 4;
+    static const uint64_t SLOT_FLAGS = 0xff;
+    static const unsigned int VERSION_SHIFT = 8;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> meta;
+        std::atomic<uint64_t> key[3];
+
+        Slot() : meta(0) {}
+    };
+
+    /** The part of an entry that is stored in a slot. */
+    struct Key
+    {
+        uint64_t w[3];
+
+        explicit Key(const uint256 &entry)
+        {
+            for (int i = 0; i < 3; i++)
+                w[i] = ReadLE64(entry.begin() + 8 * i);
+        }
+        Key() {}
+        bool operator==(const Key &k) const { return w[0] == k.w[0] && w[1] == k.w[1] && w[2] == k.w[2]; }
+    };
+
+    /** Statistics counters, spread over several cache lines so that the lookup threads don't fight over one. */
+    struct alignas(64) StatCounters
+    {
+        std::atomic<uint64_t> nHits;
+        std::atomic<uint64_t> nMisses;
+
+        StatCounters() : nHits(0), nMisses(0) {}
+    };
+
+    std::unique_ptr<uint8_t[]> vBuffer;
+    Slot *slots;
+    uint32_t nSlots;
+    StatCounters stats[STAT_STRIPES];
+
+    // Serializes the writers, the generation state is only used with it held
+    std::mutex cs_insert;
+    uint64_t nGeneration;
+    uint32_t nGenerationSize;
+    uint32_t nGenerationCount;
+    unsigned int nMaxDepth;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+
+    /** Map 32 random bits of the key onto a slot without a division. */
+    uint32_t Position(const Key &key, unsigned int n) const
+    {
+        uint32_t r = (uint32_t)(key.w[n / 2] >> (32 * (n % 2)));
+        return (uint32_t)(((uint64_t)r * nSlots) >> 32);
+    }
+
+    /** Read the slot, returns false if it is empty or was modified while it was read. */
+    static bool Read(const Slot &slot, Key &key, uint64_t &meta)
+    {
+        meta = slot.meta.load(std::memory_order_acquire);
+        if (!(meta & SLOT_OCCUPIED) || ((meta >> VERSION_SHIFT) & 1))
+            return false;
+        for (int i = 0; i < 3; i++)
+            key.w[i] = slot.key[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (slot.meta.load(std::memory_order_relaxed) >> VERSION_SHIFT) == (meta >> VERSION_SHIFT);
+    }
+
+    /** Overwrite the slot. Requires cs_insert. */
+    static void Write(Slot &slot, const Key &key, uint64_t flags)
+    {
+        uint64_t version = (slot.meta.load(std::memory_order_relaxed) >> VERSION_SHIFT) + 1;
+        slot.meta.store(version << VERSION_SHIFT, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < 3; i++)
+            slot.key[i].store(key.w[i], std::memory_order_relaxed);
+        slot.meta.store(((version + 1) << VERSION_SHIFT) | flags, std::memory_order_release);
+    }
+
+    /** Start a new generation if the current one is full. Requires cs_insert. */
+    void CheckGeneration()
+    {
+        if (nGenerationCount < nGenerationSize)
+            return;
+        // The entries of the generation before the one that just filled up may be overwritten from now on.
+        uint64_t old = nGeneration ? 0 : SLOT_GENERATION;
+        for (uint32_t i = 0; i < nSlots; i++)
+        {
+            uint64_t meta = slots[i].meta.load(std::memory_order_relaxed);
+            if ((meta & SLOT_OCCUPIED) && (meta & SLOT_GENERATION) == old)
+                slots[i].meta.fetch_or(SLOT_ERASED, std::memory_order_relaxed);
+        }
+        nGeneration = old;
+        nGenerationCount = 0;
+    }
+
+public:
+    /** Create a cache that uses about nBytes of memory, or a cache that never holds anything if nBytes is 0. */
+    explicit CCuckooCache(size_t nBytes)
+        : slots(nullptr), nSlots(0), nGeneration(0), nGenerationSize(0), nGenerationCount(0), nMaxDepth(0),
+          nInserts(0), nEvictions(0)
+    {
+        uint64_t n = std::min((uint64_t)nBytes / sizeof(Slot), (uint64_t)0xffffffff);
+        if (n == 0)
+            return;
+        nSlots = n;
+        nGenerationSize = std::max((uint64_t)1, n * GENERATION_PERCENT / 100);
+        while (((uint64_t)1 << nMaxDepth) < n)
+            nMaxDepth++;
+
+        // Align the table so that no slot straddles two cache lines
+        vBuffer.reset(new uint8_t[n * sizeof(Slot) + 64]);
+        uintptr_t p = (uintptr_t)vBuffer.get();
+        slots = (Slot *)((p + 63) & ~(uintptr_t)63);
+        for (uint32_t i = 0; i < nSlots; i++)
+            new (&slots[i]) Slot();
+    }
+
+    /**
+     * Return whether entry is in the cache. If fErase is set a hit marks the entry as erased, it will still
+     * be found until its slot is reused.
+     */
+    bool Contains(const uint256 &entry, bool fErase)
+    {
+        Key key(entry);
+        StatCounters &counters = stats[key.w[2] % STAT_STRIPES];
+        for (unsigned int n = 0; n < HASH_COUNT && nSlots; n++)
+        {
+            Slot &slot = slots[Position(key, n)];
+            Key found;
+            uint64_t meta;
+            if (Read(slot, found, meta) && found == key)
+            {
+                if (fErase)
+                    slot.meta.fetch_or(SLOT_ERASED, std::memory_order_relaxed);
+                counters.nHits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        counters.nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /** Add entry to the cache, possibly evicting another one. */
+    void Insert(const uint256 &entry)
+    {
+        if (!nSlots)
+            return;
+        Key key(entry);
+        std::lock_guard<std::mutex> lock(cs_insert);
+        for (unsigned int n = 0; n < HASH_COUNT; n++)
+        {
+            Key found;
+            uint64_t meta;
+            Slot &slot = slots[Position(key, n)];
+            if (Read(slot, found, meta) && found == key)
+            {
+                // Keep an entry that was erased or is about to age out, as it is wanted again
+                if ((meta & SLOT_ERASED) || (meta & SLOT_GENERATION) != nGeneration)
+                    Write(slot, key, SLOT_OCCUPIED | nGeneration);
+                return;
+            }
+        }
+        CheckGeneration();
+        nGenerationCount++;
+        nInserts.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t flags = SLOT_OCCUPIED | nGeneration;
+        uint32_t nLast = nSlots;
+        for (unsigned int depth = 0; depth < nMaxDepth; depth++)
+        {
+            uint32_t pos[HASH_COUNT];
+            for (unsigned int n = 0; n < HASH_COUNT; n++)
+            {
+                pos[n] = Position(key, n);
+                uint64_t meta = slots[pos[n]].meta.load(std::memory_order_relaxed);
+                if (!(meta & SLOT_OCCUPIED) || (meta & SLOT_ERASED))
+                {
+                    Write(slots[pos[n]], key, flags);
+                    return;
+                }
+            }
+            // All slots are taken, so swap with the one after the slot this key was just moved out of
+            unsigned int next = 0;
+            for (unsigned int n = 0; n < HASH_COUNT; n++)
+                if (pos[n] == nLast)
+                    next = (n + 1) % HASH_COUNT;
+            Slot &slot = slots[pos[next]];
+            Key displaced;
+            for (int i = 0; i < 3; i++)
+                displaced.w[i] = slot.key[i].load(std::memory_order_relaxed);
+            uint64_t displacedFlags = slot.meta.load(std::memory_order_relaxed) & SLOT_FLAGS;
+            Write(slot, key, flags);
+            key = displaced;
+            flags = displacedFlags;
+            nLast = pos[next];
+        }
+        // Give up on the entry that is left over
+        nEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** The number of slots in the table */
+    uint32_t Size() const { return nSlots; }
+    Stats GetStats()
+    {
+        Stats s;
+        s.nHits = s.nMisses = 0;
+        for (unsigned int i = 0; i < STAT_STRIPES; i++)
+        {
+            s.nHits += stats[i].nHits.load(std::memory_order_relaxed);
+            s.nMisses += stats[i].nMisses.load(std::memory_order_relaxed);
+        }
+        s.nInserts = nInserts.load(std::memory_order_relaxed);
+        s.nEvictions = nEvictions.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
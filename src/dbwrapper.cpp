@@ -15,11 +15,24 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+#include <sstream>
+
+static leveldb::Options GetOptions(size_t nCacheSize, bool fIBD)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    if (fIBD)
+    {
+        // While the initial block download fills the database there is little to gain from caching tables,
+        // as the coins cache in front of it holds what is read back soon.  Larger memtables instead mean
+        // fewer and larger level 0 files, and so less data rewritten by compactions.
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 8);
+        options.write_buffer_size = nCacheSize * 3 / 8; // up to two write buffers may be held in memory simultaneously
+    }
+    else
+    {
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+        options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    }
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
     options.compression = leveldb::kNoCompression;
     options.max_open_files = 64;
@@ -33,32 +46,42 @@ static leveldb::Options GetOptions(size_t nCacheSize)
 }
 
 CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+    : fIBDMode(false), fIBDMarked(false), fSyncPending(false), fStopCompaction(false)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
-    options.create_if_missing = true;
     if (fMemory)
     {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
-        options.env = penv;
     }
     else
     {
         if (fWipe)
         {
             LogPrintf("Wiping LevelDB in %s\n", path.string());
-            leveldb::Status result = leveldb::DestroyDB(path.string(), options);
+            leveldb::Status result = leveldb::DestroyDB(path.string(), leveldb::Options());
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectories(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
-    leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
-    dbwrapper_private::HandleError(status);
+    Open(path, nCacheSize, false);
+
+    // A database that the initial block download is about to fill, or was filling when it was closed, is
+    // opened again with the options for it
+    fIBDMarked = Exists(IBD_MODE_KEY);
+    if (fIBDMarked || IsEmpty())
+    {
+        delete pdb;
+        pdb = NULL;
+        CloseOptions();
+        Open(path, nCacheSize, true);
+        fIBDMode = true;
+        LogPrintf("Opened LevelDB in %s in initial block download mode\n", path.string());
+    }
     LogPrintf("Opened LevelDB successfully\n");
 
     // The base-case obfuscation key, which is a noop.
@@ -84,29 +107,173 @@ CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory, bo
 
 CDBWrapper::~CDBWrapper()
 {
+    fStopCompaction = true;
+    if (compactionThread.joinable())
+        compactionThread.join();
+    try
+    {
+        Checkpoint();
+    }
+    catch (const dbwrapper_error &e)
+    {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
     delete pdb;
     pdb = NULL;
+    CloseOptions();
+    delete penv;
+    options.env = NULL;
+}
+
+void CDBWrapper::Open(const fs::path &path, size_t nCacheSize, bool fIBD)
+{
+    options = GetOptions(nCacheSize, fIBD);
+    options.create_if_missing = true;
+    if (penv)
+        options.env = penv;
+    leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
+    dbwrapper_private::HandleError(status);
+}
+
+void CDBWrapper::CloseOptions()
+{
     delete options.filter_policy;
     options.filter_policy = NULL;
     delete options.block_cache;
     options.block_cache = NULL;
-    delete penv;
-    options.env = NULL;
 }
 
 bool CDBWrapper::WriteBatch(CDBBatch &batch, bool fSync)
 {
+    if (fSync && fIBDMode)
+    {
+        // Set before writing, so that a checkpoint running at the same time cannot miss this write
+        fSyncPending = true;
+        fSync = false;
+    }
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
     return true;
 }
 
+void CDBWrapper::SetIBDMode(bool fIBD)
+{
+    if (fIBD)
+    {
+        // Mark the database, so that it is opened in IBD mode again if the node is restarted before the end
+        if (!fIBDMarked)
+        {
+            Write(IBD_MODE_KEY, true);
+            fIBDMarked = true;
+        }
+        fIBDMode = true;
+        return;
+    }
+    if (!fIBDMode)
+        return;
+
+    fIBDMode = false;
+    Checkpoint();
+    if (fIBDMarked)
+    {
+        Erase(IBD_MODE_KEY, true);
+        fIBDMarked = false;
+    }
+    if (!compactionThread.joinable())
+        compactionThread = boost::thread(&CDBWrapper::ThreadCompact, this);
+}
+
+bool CDBWrapper::Checkpoint()
+{
+    if (!fSyncPending.exchange(false))
+        return true;
+    // An empty synced write syncs the log, and with it everything written before
+    CDBBatch batch(*this);
+    leveldb::Status status = pdb->Write(syncoptions, &batch.batch);
+    dbwrapper_private::HandleError(status);
+    return true;
+}
+
+void CDBWrapper::WaitForCompaction()
+{
+    if (compactionThread.joinable())
+        compactionThread.join();
+}
+
+void CDBWrapper::ThreadCompact()
+{
+    RenameThread("bitcoin-dbcompact");
+    int64_t nStart = GetTimeMillis();
+    size_t nSlices = 0;
+    // Compact one slice of the keyspace at a time, each holding the keys that share their first two bytes,
+    // so that shutdown does not have to wait for the whole database.  Slices without keys are skipped, as
+    // every compaction, even of an empty range, starts a new memtable.
+    std::string strBegin;
+    while (!fStopCompaction)
+    {
+        {
+            std::unique_ptr<leveldb::Iterator> piter(pdb->NewIterator(iteroptions));
+            piter->Seek(strBegin);
+            if (!piter->Valid())
+                break;
+            strBegin = piter->key().ToString().substr(0, 2);
+        }
+        // The end of the slice is the prefix plus one, or the end of the keyspace if there is none
+        std::string strEnd = strBegin;
+        while (!strEnd.empty() && (unsigned char)strEnd.back() == 0xff)
+            strEnd.pop_back();
+        if (!strEnd.empty())
+            strEnd.back()++;
+        leveldb::Slice slBegin(strBegin), slEnd(strEnd);
+        pdb->CompactRange(&slBegin, strEnd.empty() ? NULL : &slEnd);
+        nSlices++;
+        if (strEnd.empty())
+            break;
+        strBegin = strEnd;
+    }
+    LogPrintf("Compacted %u slices of a LevelDB database after the initial block download in %.2fs%s\n", nSlices,
+        (GetTimeMillis() - nStart) * 0.001, fStopCompaction ? ", interrupted" : "");
+}
+
+bool CDBWrapper::GetProperty(const std::string &property, std::string &value) const
+{
+    return pdb->GetProperty(property, &value);
+}
+
+std::vector<CDBLevelStats> CDBWrapper::GetLevelStats() const
+{
+    // The property is a table with a header that ends in a line of dashes, and then a line per level
+    std::vector<CDBLevelStats> vStats;
+    std::string strStats;
+    if (!GetProperty("leveldb.stats", strStats))
+        return vStats;
+    std::istringstream ss(strStats);
+    std::string strLine;
+    bool fHeaderDone = false;
+    while (std::getline(ss, strLine))
+    {
+        if (!fHeaderDone)
+        {
+            fHeaderDone = strLine.compare(0, 3, "---") == 0;
+            continue;
+        }
+        CDBLevelStats stats;
+        if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &stats.nLevel, &stats.nFiles, &stats.dSizeMB,
+                &stats.dCompactionTime, &stats.dCompactionReadMB, &stats.dCompactionWriteMB) == 6)
+            vStats.push_back(stats);
+    }
+    return vStats;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
 // past the null-terminator.
 const std::string CDBWrapper::OBFUSCATE_KEY_KEY("\000obfuscate_key", 14);
 
+// Prefixed with a zero byte, like the obfuscation key, to stay out of the way of the databases' own keys
+const std::string CDBWrapper::IBD_MODE_KEY("\000ibd_mode", 9);
+
 const unsigned int CDBWrapper::OBFUSCATE_KEY_NUM_BYTES = 8;
 
 /**
@@ -127,6 +294,20 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+std::shared_ptr<const leveldb::Snapshot> CDBWrapper::GetSnapshot()
+{
+    leveldb::DB *db = pdb;
+    return std::shared_ptr<const leveldb::Snapshot>(
+        pdb->GetSnapshot(), [db](const leveldb::Snapshot *snapshot) { db->ReleaseSnapshot(snapshot); });
+}
+
+CDBIterator *CDBWrapper::NewIterator(const std::shared_ptr<const leveldb::Snapshot> &snapshot)
+{
+    leveldb::ReadOptions options = iteroptions;
+    options.snapshot = snapshot.get();
+    return new CDBIterator(*this, pdb->NewIterator(options), snapshot);
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
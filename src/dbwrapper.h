@@ -16,6 +16,11 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <atomic>
+#include <memory>
+
+#include <boost/thread.hpp>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
@@ -27,6 +32,17 @@ public:
 
 class CDBWrapper;
 
+/** What LevelDB reports about one level of a database, the compaction figures are since it was opened */
+struct CDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    double dCompactionTime;
+    double dCompactionReadMB;
+    double dCompactionWriteMB;
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private
@@ -119,13 +135,19 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    //! The snapshot the iterator reads from, if it was created on one, released after the iterator
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
 
 public:
     /**
      * @param[in] _parent          Parent CDBWrapper instance.
      * @param[in] _piter           The original leveldb iterator.
+     * @param[in] _snapshot        The snapshot _piter reads from, if any.
      */
-    CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) : parent(_parent), piter(_piter){};
+    CDBIterator(const CDBWrapper &_parent,
+        leveldb::Iterator *_piter,
+        const std::shared_ptr<const leveldb::Snapshot> &_snapshot = nullptr)
+        : parent(_parent), piter(_piter), snapshot(_snapshot){};
     ~CDBIterator();
 
     bool Valid() const;
@@ -206,6 +228,23 @@ private:
     //! the database itself
     leveldb::DB *pdb;
 
+    //! whether the database is written in initial block download mode, see SetIBDMode()
+    std::atomic<bool> fIBDMode;
+    //! whether the database holds the IBD_MODE_KEY marker
+    bool fIBDMarked;
+    //! whether writes that asked to be synced were not since the last sync
+    std::atomic<bool> fSyncPending;
+    //! the compaction deferred until the end of the initial block download, and how to stop it
+    boost::thread compactionThread;
+    std::atomic<bool> fStopCompaction;
+
+    //! the key marking a database that is being filled by the initial block download
+    static const std::string IBD_MODE_KEY;
+
+    void Open(const fs::path &path, size_t nCacheSize, bool fIBD);
+    void CloseOptions();
+    void ThreadCompact();
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -301,6 +340,27 @@ public:
 
     bool WriteBatch(CDBBatch &batch, bool fSync = false);
 
+    /**
+     * Switch the write mode for the initial block download on or off.
+     *
+     * In IBD mode writes that ask to be synced are not, and Checkpoint() syncs them later.  A database that
+     * is opened empty, or was still in IBD mode when it was closed, is opened with larger memtables, which
+     * cuts down the number of level 0 files and the compactions needed to merge them.  Compacting the
+     * whole database into its final shape is left until IBD mode is switched off, and then done in the
+     * background.
+     */
+    void SetIBDMode(bool fIBD);
+    bool IsIBDMode() const { return fIBDMode; }
+    //! Sync the writes that asked for it while in IBD mode, if there were any
+    bool Checkpoint();
+    //! Block until the compaction started by switching IBD mode off is done
+    void WaitForCompaction();
+
+    //! A LevelDB property such as "leveldb.stats", see leveldb/db.h
+    bool GetProperty(const std::string &property, std::string &value) const;
+    //! The statistics of the levels that have files or were compacted, from the "leveldb.stats" property
+    std::vector<CDBLevelStats> GetLevelStats() const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush() { return true; }
     bool Sync()
@@ -310,6 +370,13 @@ public:
     }
 
     CDBIterator *NewIterator() { return new CDBIterator(*this, pdb->NewIterator(iteroptions)); }
+    /**
+     * A consistent view of the database that stays as it is while writes go on.  It is released once
+     * the last copy of the pointer, and the last iterator created on it, are gone.
+     */
+    std::shared_ptr<const leveldb::Snapshot> GetSnapshot();
+    //! An iterator over the database as it was when the snapshot was taken
+    CDBIterator *NewIterator(const std::shared_ptr<const leveldb::Snapshot> &snapshot);
     /**
      * Return true if the database managed by this class contains no entries.
      */
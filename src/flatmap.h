@@ -0,0 +1,393 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <iterator>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * A hash map for very many small entries, such as the coins cache.
+ *
+ * The entries live in an arena of fixed size chunks rather than in a node allocation each. The index is an
+ * open addressing table with linear probing whose buckets hold 32 bits of the entry's hash and the number of
+ * its node, so a lookup compares keys only for the few buckets whose hash bits match, and the whole table is
+ * one allocation.
+ *
+ * Entries never move, so like with std::unordered_map references to them stay valid until they are erased,
+ * whatever else is inserted or erased. Iterators are only invalidated by erasing the entry they point to.
+ * Iteration is in the order of the nodes in the arena. A chunk is freed as soon as its last entry is erased,
+ * so erasing entries returns memory. The table itself does not shrink, as with std::unordered_map.
+ */
+template <typename K, typename V, typename Hash>
+class CFlatHashMap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    static const uint32_t NODES_PER_CHUNK = 64;
+    static const uint32_t NO_NODE = 0xffffffff;
+    static const unsigned int MIN_TABLE_BITS = 4;
+
+    struct Chunk
+    {
+        typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type nodes[NODES_PER_CHUNK];
+        // Bit i is set when node i holds an entry
+        uint64_t live;
+        // Free nodes below nUsed form a list through their storage, the ones above it were never used
+        uint32_t nFreeHead;
+        uint32_t nUsed;
+        uint32_t nLive;
+        // Position in vPartialChunks, or NO_NODE if this chunk is full
+        uint32_t nPartialPos;
+
+        Chunk() : live(0), nFreeHead(NO_NODE), nUsed(0), nLive(0), nPartialPos(NO_NODE) {}
+        value_type *Node(uint32_t i) { return reinterpret_cast<value_type *>(&nodes[i]); }
+        uint32_t &NextFree(uint32_t i) { return *reinterpret_cast<uint32_t *>(&nodes[i]); }
+    };
+
+    struct Bucket
+    {
+        uint32_t tag;
+        uint32_t node;
+    };
+
+    std::vector<Chunk *> vChunks;
+    // Chunks that have free nodes, and slots in vChunks whose chunk has been freed
+    std::vector<uint32_t> vPartialChunks;
+    std::vector<uint32_t> vFreeChunkIds;
+    size_t nChunks;
+
+    std::vector<Bucket> vTable;
+    unsigned int nTableBits;
+    size_t nSize;
+    Hash hasher;
+
+    value_type *Node(uint32_t node) const { return vChunks[node / NODES_PER_CHUNK]->Node(node % NODES_PER_CHUNK); }
+    uint32_t Tag(const K &key) const
+    {
+        uint64_t h = hasher(key);
+        return (uint32_t)h ^ (uint32_t)(h >> 32);
+    }
+    // The table position is taken from the top bits of the tag, so growing the table doesn't rehash any keys.
+    size_t Home(uint32_t tag) const { return tag >> (32 - nTableBits); }
+    size_t Mask() const { return vTable.size() - 1; }
+
+    /** The bucket holding key, or NO_NODE in the node of the empty bucket where it would go. */
+    size_t FindBucket(const K &key, uint32_t tag) const
+    {
+        if (vTable.empty())
+            return 0;
+        size_t pos = Home(tag);
+        while (true)
+        {
+            const Bucket &b = vTable[pos];
+            if (b.node == NO_NODE || (b.tag == tag && Node(b.node)->first == key))
+                return pos;
+            pos = (pos + 1) & Mask();
+        }
+    }
+
+    void PlaceBucket(uint32_t tag, uint32_t node)
+    {
+        size_t pos = Home(tag);
+        while (vTable[pos].node != NO_NODE)
+            pos = (pos + 1) & Mask();
+        vTable[pos].tag = tag;
+        vTable[pos].node = node;
+    }
+
+    /** Make room for one more entry, keeping the table at most 3/4 full. */
+    void Reserve()
+    {
+        if (!vTable.empty() && (nSize + 1) * 4 <= vTable.size() * 3)
+            return;
+        std::vector<Bucket> vOld;
+        vOld.swap(vTable);
+        nTableBits = vOld.empty() ? MIN_TABLE_BITS : nTableBits + 1;
+        assert(nTableBits <= 32);
+        vTable.assign((size_t)1 << nTableBits, Bucket{0, NO_NODE});
+        for (const Bucket &b : vOld)
+            if (b.node != NO_NODE)
+                PlaceBucket(b.tag, b.node);
+    }
+
+    void RemovePartial(Chunk *chunk)
+    {
+        uint32_t last = vPartialChunks.back();
+        vPartialChunks[chunk->nPartialPos] = last;
+        vChunks[last]->nPartialPos = chunk->nPartialPos;
+        vPartialChunks.pop_back();
+        chunk->nPartialPos = NO_NODE;
+    }
+
+    uint32_t AllocNode()
+    {
+        if (vPartialChunks.empty())
+        {
+            uint32_t id;
+            if (vFreeChunkIds.empty())
+            {
+                assert(vChunks.size() < NO_NODE / NODES_PER_CHUNK);
+                id = vChunks.size();
+                vChunks.push_back(nullptr);
+            }
+            else
+            {
+                id = vFreeChunkIds.back();
+                vFreeChunkIds.pop_back();
+            }
+            vChunks[id] = new Chunk();
+            vChunks[id]->nPartialPos = vPartialChunks.size();
+            vPartialChunks.push_back(id);
+            nChunks++;
+        }
+        uint32_t id = vPartialChunks.back();
+        Chunk *chunk = vChunks[id];
+        uint32_t i;
+        if (chunk->nFreeHead != NO_NODE)
+        {
+            i = chunk->nFreeHead;
+            chunk->nFreeHead = chunk->NextFree(i);
+        }
+        else
+            i = chunk->nUsed++;
+        chunk->live |= (uint64_t)1 << i;
+        if (++chunk->nLive == NODES_PER_CHUNK)
+            RemovePartial(chunk);
+        return id * NODES_PER_CHUNK + i;
+    }
+
+    void FreeNode(uint32_t node)
+    {
+        uint32_t id = node / NODES_PER_CHUNK, i = node % NODES_PER_CHUNK;
+        Chunk *chunk = vChunks[id];
+        chunk->Node(i)->~value_type();
+        chunk->live &= ~((uint64_t)1 << i);
+        if (chunk->nLive-- == NODES_PER_CHUNK)
+        {
+            chunk->nPartialPos = vPartialChunks.size();
+            vPartialChunks.push_back(id);
+        }
+        if (chunk->nLive == 0)
+        {
+            RemovePartial(chunk);
+            delete chunk;
+            vChunks[id] = nullptr;
+            vFreeChunkIds.push_back(id);
+            nChunks--;
+            return;
+        }
+        chunk->NextFree(i) = chunk->nFreeHead;
+        chunk->nFreeHead = i;
+    }
+
+    /** The first node at or after node that holds an entry, or the end. */
+    uint32_t NextLive(uint32_t node) const
+    {
+        uint32_t nEnd = vChunks.size() * NODES_PER_CHUNK;
+        while (node < nEnd)
+        {
+            const Chunk *chunk = vChunks[node / NODES_PER_CHUNK];
+            uint64_t live = chunk ? chunk->live >> (node % NODES_PER_CHUNK) : 0;
+            if (live)
+            {
+                while (!(live & 1))
+                {
+                    live >>= 1;
+                    node++;
+                }
+                return node;
+            }
+            node = (node / NODES_PER_CHUNK + 1) * NODES_PER_CHUNK;
+        }
+        return nEnd;
+    }
+
+public:
+    template <bool fConst>
+    class Iterator
+    {
+        friend class CFlatHashMap;
+        template <bool>
+        friend class Iterator;
+        typedef typename std::conditional<fConst, const CFlatHashMap, CFlatHashMap>::type map_type;
+        map_type *map;
+        uint32_t node;
+
+        Iterator(map_type *mapIn, uint32_t nodeIn) : map(mapIn), node(nodeIn) {}
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::conditional<fConst, const typename CFlatHashMap::value_type,
+            typename CFlatHashMap::value_type>::type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type *pointer;
+        typedef value_type &reference;
+
+        Iterator() : map(nullptr), node(0) {}
+        // Allow converting an iterator to a const_iterator
+        template <bool fOtherConst, typename = typename std::enable_if<fConst || !fOtherConst>::type>
+        Iterator(const Iterator<fOtherConst> &it) : map(it.map), node(it.node)
+        {
+        }
+
+        reference operator*() const { return *map->Node(node); }
+        pointer operator->() const { return map->Node(node); }
+        Iterator &operator++()
+        {
+            node = map->NextLive(node + 1);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator it(*this);
+            ++*this;
+            return it;
+        }
+        bool operator==(const Iterator &it) const { return node == it.node; }
+        bool operator!=(const Iterator &it) const { return node != it.node; }
+    };
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    CFlatHashMap() : nChunks(0), nTableBits(0), nSize(0) {}
+    CFlatHashMap(const CFlatHashMap &) = delete;
+    CFlatHashMap &operator=(const CFlatHashMap &) = delete;
+    ~CFlatHashMap() { clear(); }
+    iterator begin() { return iterator(this, NextLive(0)); }
+    iterator end() { return iterator(this, vChunks.size() * NODES_PER_CHUNK); }
+    const_iterator begin() const { return const_iterator(this, NextLive(0)); }
+    const_iterator end() const { return const_iterator(this, vChunks.size() * NODES_PER_CHUNK); }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    iterator find(const K &key)
+    {
+        size_t pos = FindBucket(key, Tag(key));
+        return vTable.empty() || vTable[pos].node == NO_NODE ? end() : iterator(this, vTable[pos].node);
+    }
+
+    const_iterator find(const K &key) const
+    {
+        size_t pos = FindBucket(key, Tag(key));
+        return vTable.empty() || vTable[pos].node == NO_NODE ? end() : const_iterator(this, vTable[pos].node);
+    }
+
+    size_t count(const K &key) const { return find(key) != end(); }
+    /** Insert the entry constructed from args unless its key is already there, like std::unordered_map. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args &&... args)
+    {
+        value_type value(std::forward<Args>(args)...);
+        uint32_t tag = Tag(value.first);
+        size_t pos = FindBucket(value.first, tag);
+        if (!vTable.empty() && vTable[pos].node != NO_NODE)
+            return std::make_pair(iterator(this, vTable[pos].node), false);
+
+        Reserve();
+        uint32_t node = AllocNode();
+        new (Node(node)) value_type(std::move(value));
+        PlaceBucket(tag, node);
+        nSize++;
+        return std::make_pair(iterator(this, node), true);
+    }
+
+    V &operator[](const K &key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            it = emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first;
+        return it->second;
+    }
+
+    /** Erase the entry it points to and return an iterator to the entry after it. */
+    iterator erase(const_iterator it)
+    {
+        uint32_t node = it.node;
+        size_t pos = Home(Tag(Node(node)->first));
+        while (vTable[pos].node != node)
+            pos = (pos + 1) & Mask();
+
+        // Move later entries of the probe sequence up into the hole, so that lookups never need to skip one
+        size_t mask = Mask();
+        size_t next = (pos + 1) & mask;
+        while (vTable[next].node != NO_NODE)
+        {
+            size_t home = Home(vTable[next].tag);
+            size_t dist = (next - pos) & mask;
+            size_t distHome = (home - pos) & mask;
+            if (distHome == 0 || distHome > dist)
+            {
+                vTable[pos] = vTable[next];
+                pos = next;
+            }
+            next = (next + 1) & mask;
+        }
+        vTable[pos].node = NO_NODE;
+
+        iterator ret(this, NextLive(node + 1));
+        FreeNode(node);
+        nSize--;
+        return ret;
+    }
+
+    size_t erase(const K &key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (Chunk *chunk : vChunks)
+        {
+            if (!chunk)
+                continue;
+            for (uint32_t i = 0; i < NODES_PER_CHUNK; i++)
+                if (chunk->live & ((uint64_t)1 << i))
+                    chunk->Node(i)->~value_type();
+            delete chunk;
+        }
+        std::vector<Chunk *>().swap(vChunks);
+        std::vector<uint32_t>().swap(vPartialChunks);
+        std::vector<uint32_t>().swap(vFreeChunkIds);
+        std::vector<Bucket>().swap(vTable);
+        nChunks = 0;
+        nTableBits = 0;
+        nSize = 0;
+    }
+
+    /** The memory allocated by the map, not counting memory owned by the keys and values. */
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(sizeof(Chunk)) * nChunks + memusage::DynamicUsage(vTable) +
+               memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vPartialChunks) +
+               memusage::DynamicUsage(vFreeChunkIds);
+    }
+};
+
+namespace memusage
+{
+template <typename K, typename V, typename Hash>
+static inline size_t DynamicUsage(const CFlatHashMap<K, V, Hash> &m)
+{
+    return m.DynamicMemoryUsage();
+}
+}
+
+#endif // BITCOIN_FLATMAP_H
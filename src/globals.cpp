@@ -68,6 +68,7 @@ int64_t nTimeOffset = 0;
 CCriticalSection cs_rpcWarmup;
 
 CCriticalSection cs_main;
+CBlockIndexPool poolBlockIndex;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CWaitableCriticalSection csBestBlock;
@@ -285,6 +286,17 @@ CStatHistory<uint64_t> sendAmt;
 CStatHistory<uint64_t> nTxValidationTime("txValidationTime", STAT_OP_MAX | STAT_INDIVIDUAL);
 CCriticalSection cs_blockvalidationtime;
 CStatHistory<uint64_t> nBlockValidationTime("blockValidationTime", STAT_OP_MAX | STAT_INDIVIDUAL);
+CStatHistory<unsigned int> nScriptCheckQueueDepth("scriptcheck/queueDepth", STAT_OP_MAX);
+CStatHistory<uint64_t> nScriptCheckSteals("scriptcheck/steals", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nScriptCheckCount("scriptcheck/checks", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nScriptCheckAllocations("scriptcheck/allocations", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nSigCacheHits("sigcache/hits", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nSigCacheMisses("sigcache/misses", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nSigCacheInserts("sigcache/inserts", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nSigCacheEvictions("sigcache/evictions", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nBlockCacheHits("blockcache/hits", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nBlockCacheMisses("blockcache/misses", STAT_OP_SUM | STAT_KEEP);
+CStatHistory<uint64_t> nBlockCacheEvictions("blockcache/evictions", STAT_OP_SUM | STAT_KEEP);
 
 CThinBlockData thindata; // Singleton class
 
@@ -42,6 +42,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "wallet/db.h"
@@ -226,6 +227,9 @@ void Shutdown()
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        // Finishes any write still in flight
+        delete pcoinsflusher;
+        pcoinsflusher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
@@ -386,6 +390,44 @@ void CleanupBlockRevFiles()
     }
 }
 
+/** Wait until the headers up to the base block of a UTXO snapshot are known, then load the snapshot. */
+static void LoadUTXOSnapshotWhenReady(fs::path path)
+{
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    CUTXOSnapshotHeader header;
+    if (!ReadUTXOSnapshotHeader(path, header))
+    {
+        LogPrintf("Warning: Could not read UTXO snapshot %s\n", path.string());
+        return;
+    }
+    LogPrintf("Waiting for the headers up to block %s to load UTXO snapshot %s\n", header.hashBaseBlock.ToString(),
+        path.string());
+    while (true)
+    {
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(header.hashBaseBlock);
+            if (mi != mapBlockIndex.end())
+            {
+                if (chainActive.Contains(mi->second))
+                {
+                    LogPrintf("Not loading UTXO snapshot %s, the active chain already contains its base block\n",
+                        path.string());
+                    return;
+                }
+                if (pindexBestHeader && pindexBestHeader->GetAncestor(mi->second->nHeight) == mi->second)
+                    break;
+            }
+        }
+        MilliSleep(1000);
+    }
+
+    CValidationState state;
+    if (!ActivateUTXOSnapshot(path, state))
+        LogPrintf("Warning: Could not load UTXO snapshot %s: %s\n", path.string(), state.GetRejectReason());
+}
+
 void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CChainParams &chainparams = Params();
@@ -453,6 +495,9 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+    // -loadutxosnapshot=
+    if (mapArgs.count("-loadutxosnapshot"))
+        LoadUTXOSnapshotWhenReady(GetArg("-loadutxosnapshot", ""));
 }
 
 /** Sanity checks
@@ -990,13 +1035,21 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler)
             {
                 UnloadBlockIndex();
                 delete pcoinsTip;
-                delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcoinsflusher;
+                pcoinsflusher = NULL;
+                delete pcoinsdbview;
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
-                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                if (GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH))
+                {
+                    pcoinsflusher = new CCoinsViewBackgroundFlush(pcoinsdbview);
+                    pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsflusher);
+                }
+                else
+                    pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
                 if (fReindex)
@@ -1014,6 +1067,27 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler)
                         strLoadError = _("Error upgrading chainstate database");
                         break;
                     }
+
+                    // Coins without a best block are left behind by an interrupted UTXO snapshot load
+                    if (pcoinsdbview->GetBestBlock().IsNull() &&
+                        std::unique_ptr<CCoinsViewCursor>(pcoinsdbview->Cursor())->Valid())
+                    {
+                        strLoadError = _("The chainstate database is incomplete, a UTXO snapshot load was "
+                                         "interrupted");
+                        break;
+                    }
+
+                    // Databases written before the UTXO set commitment was kept need it computed once
+                    CUTXOCommitment commitment;
+                    if (!pcoinsdbview->GetCommitment(commitment))
+                    {
+                        uiInterface.InitMessage(_("Computing UTXO set commitment..."));
+                        if (!pcoinsdbview->RebuildCommitment(GetNumCores()))
+                        {
+                            strLoadError = _("Error computing UTXO set commitment");
+                            break;
+                        }
+                    }
                 }
 
                 if (!LoadBlockIndex())
@@ -1070,7 +1144,8 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler)
                     }
                 }
 
-                if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                CCoinsView *pcoinsverify = pcoinsflusher ? (CCoinsView *)pcoinsflusher : pcoinsdbview;
+                if (!CVerifyDB().VerifyDB(chainparams, pcoinsverify, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                         GetArg("-checkblocks", DEFAULT_CHECKBLOCKS)))
                 {
                     strLoadError = _("Corrupted block database detected");
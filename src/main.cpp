@@ -9,6 +9,8 @@
 
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
+#include "blockfilemap.h"
 #include "buip055fork.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -18,6 +20,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "cuckoocache.h"
 #include "dosman.h"
 #include "expedited.h"
 #include "hash.h"
@@ -43,6 +47,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 #include "versionbits.h"
 
@@ -72,6 +77,7 @@
 CBlockIndex *pindexBestHeader = NULL;
 
 CCoinsViewDB *pcoinsdbview = nullptr;
+CCoinsViewBackgroundFlush *pcoinsflusher = nullptr;
 
 int64_t nTimeBestReceived = 0;
 // BU moved CWaitableCriticalSection csBestBlock;
@@ -1156,25 +1162,42 @@ bool IsCashHFEnabled(const CChainParams &chainparams, const CBlockIndex *pindexP
 }
 #endif
 
-bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
-    CValidationState &state,
-    const CTransaction &consttx,
-    bool fLimitFree,
-    bool *pfMissingInputs,
-    bool fOverrideMempoolLimit,
-    bool fRejectAbsurdFee,
-    std::vector<COutPoint> &vCoinsToUncache)
+/**
+ * A transaction on its way into the mempool.  AcceptToMemoryPool works through it in stages: the context free
+ * checks need no locks, the checks against the chain and the mempool need cs_main, the scripts are checked
+ * against the coins collected under the lock, and the transaction is then added under cs_main again.
+ */
+struct CTxAdmission
 {
-    unsigned int forkVerifyFlags = 0;
-    CTransaction tx = consttx;
-    unsigned int nSigOps = 0;
+    CTransaction tx;
+    uint256 hash;
+    int64_t nStartTime;
+    unsigned int forkVerifyFlags;
+    //! The script verification flags of the block after pindexTip
+    unsigned int nextBlockFlags;
+    //! The tip the inputs were looked up on
+    const CBlockIndex *pindexTip;
+    //! The mempool's transactions updated count when the inputs were looked up
+    unsigned int nMempoolUpdated;
+    //! The coins spent by tx, in input order
+    std::vector<Coin> spentCoins;
+    std::unique_ptr<CTxMemPoolEntry> pentry;
+    //! In-mempool ancestors, valid as long as nothing was added to or removed from the mempool
+    CTxMemPool::setEntries setAncestors;
+    unsigned int nSigOps;
     ValidationResourceTracker resourceTracker;
-    unsigned int nSize = 0;
-    uint64_t start = GetTimeMicros();
-    AssertLockHeld(cs_main);
-    if (pfMissingInputs)
-        *pfMissingInputs = false;
 
+    CTxAdmission(const CTransaction &txIn)
+        : tx(txIn), hash(txIn.GetHash()), nStartTime(GetTimeMicros()), forkVerifyFlags(0), nextBlockFlags(0),
+          pindexTip(NULL), nMempoolUpdated(0), nSigOps(0)
+    {
+    }
+};
+
+/** The checks of a transaction that need neither the chain nor the mempool. */
+static bool PreCheckAdmission(CValidationState &state, CTxAdmission &adm)
+{
+    const CTransaction &tx = adm.tx;
     if (!CheckTransaction(tx, state))
         return false;
 
@@ -1188,9 +1211,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
     // This code uses the system time to determine when to start rejecting which is inaccurate relative to the
     // actual activation time (defined by times in the blocks).
     // But its ok to reject these transactions from the mempool a little early (or late).
-    if ((miningForkTime.value != 0) && (start / 1000000 >= miningForkTime.value - (2 * 60 * 60)))
+    if ((miningForkTime.value != 0) && (adm.nStartTime / 1000000 >= miningForkTime.value - (2 * 60 * 60)))
     {
-        forkVerifyFlags = SCRIPT_ENABLE_SIGHASH_FORKID;
+        adm.forkVerifyFlags = SCRIPT_ENABLE_SIGHASH_FORKID;
         if (IsTxOpReturnInvalid(tx))
             return state.DoS(0, false, REJECT_WRONG_FORK, "wrong-fork");
     }
@@ -1200,6 +1223,39 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
     if (fRequireStandard && !IsStandardTx(tx, reason))
         return state.DoS(0, false, REJECT_NONSTANDARD, reason);
 
+    return true;
+}
+
+/** Find the in-mempool ancestors of a transaction, within the ancestor and descendant limits. */
+static bool CalculateAdmissionAncestors(CTxMemPool &pool, CValidationState &state, CTxAdmission &adm)
+{
+    size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    std::string errString;
+    adm.setAncestors.clear();
+    if (!pool.CalculateMemPoolAncestors(*adm.pentry, adm.setAncestors, nLimitAncestors, nLimitAncestorSize,
+            nLimitDescendants, nLimitDescendantSize, errString))
+    {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+    }
+    return true;
+}
+
+/** Check a transaction against the chain and the mempool and collect the coins its scripts spend. */
+static bool PrepareAdmission(CTxMemPool &pool,
+    CValidationState &state,
+    CTxAdmission &adm,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    bool fRejectAbsurdFee,
+    std::vector<COutPoint> &vCoinsToUncache)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = adm.tx;
+    const uint256 &hash = adm.hash;
+
     // Don't relay version 2 transactions until CSV is active, and we can be
     // sure that such transactions will be mined (unless we're on
     // -testnet/-regtest).
@@ -1217,7 +1273,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
         return state.DoS(0, false, REJECT_NONSTANDARD, "non-final");
 
     // is it already in the memory pool?
-    uint256 hash = tx.GetHash();
     if (pool.exists(hash))
         return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
 
@@ -1235,265 +1290,316 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
         }
     }
 
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+
+    CAmount nValueIn = 0;
+    LockPoints lp;
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        view.SetBackend(viewMemPool);
 
-        CAmount nValueIn = 0;
-        LockPoints lp;
+        // do all inputs exist?
+        BOOST_FOREACH (const CTxIn txin, tx.vin)
         {
-            LOCK(pool.cs);
-            CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-            view.SetBackend(viewMemPool);
-
-            // do all inputs exist?
-            BOOST_FOREACH (const CTxIn txin, tx.vin)
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
             {
-                if (!pcoinsTip->HaveCoinInCache(txin.prevout))
-                {
-                    vCoinsToUncache.push_back(txin.prevout);
-                }
-                if (!view.HaveCoin(txin.prevout))
+                vCoinsToUncache.push_back(txin.prevout);
+            }
+            if (!view.HaveCoin(txin.prevout))
+            {
+                if (pfMissingInputs)
                 {
-                    if (pfMissingInputs)
-                    {
-                        *pfMissingInputs = true;
-                    }
-                    // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
-                    return false;
+                    *pfMissingInputs = true;
                 }
+                // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
+                return false;
             }
+        }
 
-            // Bring the best block into scope
-            view.GetBestBlock();
+        // Bring the best block into scope
+        view.GetBestBlock();
 
-            nValueIn = view.GetValueIn(tx);
+        nValueIn = view.GetValueIn(tx);
 
-            // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-            view.SetBackend(dummy);
+        // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
+        view.SetBackend(dummy);
 
-            // Only accept BIP68 sequence locked transactions that can be mined in the next
-            // block; we don't want our mempool filled up with transactions that can't
-            // be mined yet.
-            // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-            // CoinsViewCache instead of create its own
-            if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
-                return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
-        }
+        // Only accept BIP68 sequence locked transactions that can be mined in the next
+        // block; we don't want our mempool filled up with transactions that can't
+        // be mined yet.
+        // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
+        // CoinsViewCache instead of create its own
+        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+            return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+    }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
 
-        nSigOps = GetLegacySigOpCount(tx);
-        nSigOps += GetP2SHSigOpCount(tx, view);
+    unsigned int nSigOps = GetLegacySigOpCount(tx);
+    nSigOps += GetP2SHSigOpCount(tx, view);
 
-        CAmount nValueOut = tx.GetValueOut();
-        CAmount nFees = nValueIn - nValueOut;
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        CAmount nModifiedFees = nFees;
-        double nPriorityDummy = 0;
-        pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+    CAmount nValueOut = tx.GetValueOut();
+    CAmount nFees = nValueIn - nValueOut;
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    CAmount nModifiedFees = nFees;
+    double nPriorityDummy = 0;
+    pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
 
-        CAmount inChainInputValue;
-        double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
+    CAmount inChainInputValue;
+    double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
 
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        BOOST_FOREACH (const CTxIn &txin, tx.vin)
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    BOOST_FOREACH (const CTxIn &txin, tx.vin)
+    {
+        const Coin &coin = view.AccessCoin(txin.prevout);
+        if (coin.IsCoinBase())
         {
-            const Coin &coin = view.AccessCoin(txin.prevout);
-            if (coin.IsCoinBase())
-            {
-                fSpendsCoinbase = true;
-                break;
-            }
+            fSpendsCoinbase = true;
+            break;
         }
+    }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx),
-            inChainInputValue, fSpendsCoinbase, nSigOps, lp);
-        nSize = entry.GetTxSize();
+    adm.pentry.reset(new CTxMemPoolEntry(tx, nFees, GetTime(), dPriority, chainActive.Height(),
+        pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp));
+    const CTxMemPoolEntry &entry = *adm.pentry;
+    unsigned int nSize = entry.GetTxSize();
+    adm.nSigOps = nSigOps;
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine.
-        if (nSigOps > MAX_TX_SIGOPS)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false, strprintf("%d", nSigOps));
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine.
+    if (nSigOps > MAX_TX_SIGOPS)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false, strprintf("%d", nSigOps));
 
-        CAmount mempoolRejectFee =
-            pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
-        {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false,
-                strprintf("%d < %d", nFees, mempoolRejectFee));
-        }
-        else if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && nModifiedFees < ::minRelayTxFee.GetFee(nSize) &&
-                 !AllowFree(entry.GetPriority(chainActive.Height() + 1)))
-        {
-            // Require that free transactions have sufficient priority to be mined in the next block.
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
-        }
+    CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+    {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false,
+            strprintf("%d < %d", nFees, mempoolRejectFee));
+    }
+    else if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && nModifiedFees < ::minRelayTxFee.GetFee(nSize) &&
+             !AllowFree(entry.GetPriority(chainActive.Height() + 1)))
+    {
+        // Require that free transactions have sufficient priority to be mined in the next block.
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
+    }
 
-        // BU - Xtreme Thinblocks Auto Mempool Limiter - begin section
-        /* Continuously rate-limit free (really, very-low-fee) transactions
-         * This mitigates 'penny-flooding' -- sending thousands of free transactions just to
-         * be annoying or make others' transactions take longer to confirm. */
-        // maximum feeCutoff in satoshi per byte
-        static const double maxFeeCutoff =
-            boost::lexical_cast<double>(GetArg("-maxlimitertxfee", DEFAULT_MAXLIMITERTXFEE));
-        // starting value for feeCutoff in satoshi per byte
-        static const double initFeeCutoff =
-            boost::lexical_cast<double>(GetArg("-minlimitertxfee", DEFAULT_MINLIMITERTXFEE));
-        static const int nLimitFreeRelay = GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY);
+    // BU - Xtreme Thinblocks Auto Mempool Limiter - begin section
+    /* Continuously rate-limit free (really, very-low-fee) transactions
+     * This mitigates 'penny-flooding' -- sending thousands of free transactions just to
+     * be annoying or make others' transactions take longer to confirm. */
+    // maximum feeCutoff in satoshi per byte
+    static const double maxFeeCutoff = boost::lexical_cast<double>(GetArg("-maxlimitertxfee", DEFAULT_MAXLIMITERTXFEE));
+    // starting value for feeCutoff in satoshi per byte
+    static const double initFeeCutoff = boost::lexical_cast<double>(GetArg("-minlimitertxfee", DEFAULT_MINLIMITERTXFEE));
+    static const int nLimitFreeRelay = GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY);
 
-        // get current memory pool size
-        uint64_t poolBytes = pool.GetTotalTxSize();
+    // get current memory pool size
+    uint64_t poolBytes = pool.GetTotalTxSize();
 
-        // Calculate feeCutoff in satoshis per byte:
-        //   When the feeCutoff is larger than the satoshiPerByte of the
-        //   current transaction then spam blocking will be in effect. However
-        //   Some free transactions will still get through based on -limitfreerelay
-        static double feeCutoff;
-        static double nFreeLimit = nLimitFreeRelay;
-        static int64_t nLastTime;
-        int64_t nNow = GetTime();
+    // Calculate feeCutoff in satoshis per byte:
+    //   When the feeCutoff is larger than the satoshiPerByte of the
+    //   current transaction then spam blocking will be in effect. However
+    //   Some free transactions will still get through based on -limitfreerelay
+    static double feeCutoff;
+    static double nFreeLimit = nLimitFreeRelay;
+    static int64_t nLastTime;
+    int64_t nNow = GetTime();
 
-        // When the mempool starts falling use an exponentially decaying ~24 hour window:
-        // nFreeLimit = nFreeLimit + ((double)(DEFAULT_LIMIT_FREE_RELAY - nFreeLimit) / pow(1.0 - 1.0/86400,
-        // (double)(nNow - nLastTime)));
-        nFreeLimit /= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+    // When the mempool starts falling use an exponentially decaying ~24 hour window:
+    // nFreeLimit = nFreeLimit + ((double)(DEFAULT_LIMIT_FREE_RELAY - nFreeLimit) / pow(1.0 - 1.0/86400,
+    // (double)(nNow - nLastTime)));
+    nFreeLimit /= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
 
-        // When the mempool starts falling use an exponentially decaying ~24 hour window:
-        feeCutoff *= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+    // When the mempool starts falling use an exponentially decaying ~24 hour window:
+    feeCutoff *= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
 
-        uint64_t nLargestBlockSeen = LargestBlockSeen();
+    uint64_t nLargestBlockSeen = LargestBlockSeen();
 
-        if (poolBytes < nLargestBlockSeen)
-        {
-            feeCutoff = std::max(feeCutoff, initFeeCutoff);
-            nFreeLimit = std::min(nFreeLimit, (double)nLimitFreeRelay);
-        }
-        else if (poolBytes < (nLargestBlockSeen * MAX_BLOCK_SIZE_MULTIPLIER))
-        {
-            // Gradually choke off what is considered a free transaction
-            feeCutoff =
-                std::max(feeCutoff, initFeeCutoff + ((maxFeeCutoff - initFeeCutoff) * (poolBytes - nLargestBlockSeen) /
-                                                        (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1))));
+    if (poolBytes < nLargestBlockSeen)
+    {
+        feeCutoff = std::max(feeCutoff, initFeeCutoff);
+        nFreeLimit = std::min(nFreeLimit, (double)nLimitFreeRelay);
+    }
+    else if (poolBytes < (nLargestBlockSeen * MAX_BLOCK_SIZE_MULTIPLIER))
+    {
+        // Gradually choke off what is considered a free transaction
+        feeCutoff =
+            std::max(feeCutoff, initFeeCutoff + ((maxFeeCutoff - initFeeCutoff) * (poolBytes - nLargestBlockSeen) /
+                                                    (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1))));
 
-            // Gradually choke off the nFreeLimit as well but leave at least DEFAULT_MIN_LIMITFREERELAY
-            // So that some free transactions can still get through
-            nFreeLimit = std::min(
-                nFreeLimit, ((double)nLimitFreeRelay - ((double)(nLimitFreeRelay - DEFAULT_MIN_LIMITFREERELAY) *
-                                                           (double)(poolBytes - nLargestBlockSeen) /
-                                                           (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1)))));
-            if (nFreeLimit < DEFAULT_MIN_LIMITFREERELAY)
-                nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
-        }
-        else
-        {
-            feeCutoff = maxFeeCutoff;
+        // Gradually choke off the nFreeLimit as well but leave at least DEFAULT_MIN_LIMITFREERELAY
+        // So that some free transactions can still get through
+        nFreeLimit = std::min(
+            nFreeLimit, ((double)nLimitFreeRelay - ((double)(nLimitFreeRelay - DEFAULT_MIN_LIMITFREERELAY) *
+                                                       (double)(poolBytes - nLargestBlockSeen) /
+                                                       (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1)))));
+        if (nFreeLimit < DEFAULT_MIN_LIMITFREERELAY)
             nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
-        }
-
-        minRelayTxFee = CFeeRate(feeCutoff * 1000);
-        LogPrint("mempool",
-            "MempoolBytes:%d  LimitFreeRelay:%.5g  FeeCutOff:%.4g  FeesSatoshiPerByte:%.4g  TxBytes:%d  TxFees:%d\n",
-            poolBytes, nFreeLimit, ((double)::minRelayTxFee.GetFee(nSize)) / nSize, ((double)nFees) / nSize, nSize,
-            nFees);
-        if (fLimitFree && nFees < ::minRelayTxFee.GetFee(nSize))
-        {
-            static double dFreeCount;
+    }
+    else
+    {
+        feeCutoff = maxFeeCutoff;
+        nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
+    }
 
-            // Use an exponentially decaying ~10-minute window:
-            dFreeCount *= std::pow(1.0 - 1.0 / 600.0, (double)(nNow - nLastTime));
-            nLastTime = nNow;
+    minRelayTxFee = CFeeRate(feeCutoff * 1000);
+    LogPrint("mempool",
+        "MempoolBytes:%d  LimitFreeRelay:%.5g  FeeCutOff:%.4g  FeesSatoshiPerByte:%.4g  TxBytes:%d  TxFees:%d\n",
+        poolBytes, nFreeLimit, ((double)::minRelayTxFee.GetFee(nSize)) / nSize, ((double)nFees) / nSize, nSize, nFees);
+    if (fLimitFree && nFees < ::minRelayTxFee.GetFee(nSize))
+    {
+        static double dFreeCount;
 
-            // -limitfreerelay unit is thousand-bytes-per-minute
-            // At default rate it would take over a month to fill 1GB
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount + nSize);
-            if ((dFreeCount + nSize) >= (nFreeLimit * 10 * 1000 * nLargestBlockSeen / BLOCKSTREAM_CORE_MAX_BLOCK_SIZE))
-            {
-                thindata.UpdateMempoolLimiterBytesSaved(nSize);
-                LogPrint(
-                    "mempool", "AcceptToMemoryPool : free transaction %s rejected by rate limiter\n", hash.ToString());
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
-            }
-            dFreeCount += nSize;
-        }
+        // Use an exponentially decaying ~10-minute window:
+        dFreeCount *= std::pow(1.0 - 1.0 / 600.0, (double)(nNow - nLastTime));
         nLastTime = nNow;
-        // BU - Xtreme Thinblocks Auto Mempool Limiter - end section
-
-        // BU: we calculate the recommended fee by looking at what's in the mempool.  This starts at 0 though for an
-        // empty mempool.  So set the minimum "absurd" fee to 10000 satoshies per byte.  If for some reason fees rise
-        // above that, you can specify up to 100x what other txns are paying in the mempool
-        if (fRejectAbsurdFee && nFees > std::max((int64_t)100L * nSize, maxTxFee.value) * 100)
-            return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
-                strprintf("%d > %d", nFees, std::max((int64_t)1L, maxTxFee.value) * 10000));
-
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
-        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
-        std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants,
-                nLimitDescendantSize, errString))
-        {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
-        }
-
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        unsigned char sighashType = 0;
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS | forkVerifyFlags, true, &resourceTracker,
-                NULL, &sighashType))
-        {
-            LogPrint("mempool", "txn CheckInputs failed");
-            return false;
-        }
-        entry.UpdateRuntimeSigOps(resourceTracker.GetSigOps(), resourceTracker.GetSighashBytes());
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        unsigned char sighashType2 = 0;
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS | forkVerifyFlags, true, NULL, NULL,
-                &sighashType2))
+        // -limitfreerelay unit is thousand-bytes-per-minute
+        // At default rate it would take over a month to fill 1GB
+        LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount + nSize);
+        if ((dFreeCount + nSize) >= (nFreeLimit * 10 * 1000 * nLargestBlockSeen / BLOCKSTREAM_CORE_MAX_BLOCK_SIZE))
         {
-            return error(
-                "%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
+            thindata.UpdateMempoolLimiterBytesSaved(nSize);
+            LogPrint("mempool", "AcceptToMemoryPool : free transaction %s rejected by rate limiter\n", hash.ToString());
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
         }
+        dFreeCount += nSize;
+    }
+    nLastTime = nNow;
+    // BU - Xtreme Thinblocks Auto Mempool Limiter - end section
 
-        entry.sighashType = sighashType | sighashType2;
-        // This code denies old style tx from entering the mempool as soon as we fork
-        if (chainActive.Tip()->IsforkActiveOnNextBlock(miningForkTime.value) && !IsTxBUIP055Only(entry))
-        {
-            return state.Invalid(false, REJECT_WRONG_FORK, "txn-uses-old-sighash-algorithm");
-        }
-        // Store transaction in memory
-        pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
+    // BU: we calculate the recommended fee by looking at what's in the mempool.  This starts at 0 though for an
+    // empty mempool.  So set the minimum "absurd" fee to 10000 satoshies per byte.  If for some reason fees rise
+    // above that, you can specify up to 100x what other txns are paying in the mempool
+    if (fRejectAbsurdFee && nFees > std::max((int64_t)100L * nSize, maxTxFee.value) * 100)
+        return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
+            strprintf("%d > %d", nFees, std::max((int64_t)1L, maxTxFee.value) * 10000));
+
+    // Calculate in-mempool ancestors, up to a limit.
+    if (!CalculateAdmissionAncestors(pool, state, adm))
+        return false;
+
+    // Check against previous transactions, all but the scripts.
+    // The scripts are checked last to help prevent CPU exhaustion denial-of-service attacks.
+    if (!Consensus::CheckTxInputs(tx, state, view))
+    {
+        LogPrint("mempool", "txn CheckInputs failed");
+        return false;
+    }
+
+    adm.spentCoins.reserve(tx.vin.size());
+    BOOST_FOREACH (const CTxIn &txin, tx.vin)
+        adm.spentCoins.push_back(view.AccessCoin(txin.prevout));
+    adm.nextBlockFlags = GetBlockScriptFlags(
+        chainActive.Tip(), ComputeBlockVersion(chainActive.Tip(), chainparams.GetConsensus()), GetAdjustedTime(),
+        chainparams);
+    adm.pindexTip = chainActive.Tip();
+    adm.nMempoolUpdated = pool.GetTransactionsUpdated();
+    return true;
+}
+
+/** Check the scripts of a prepared transaction.  Needs no locks, the coins it spends were copied out. */
+static bool CheckAdmissionScripts(CValidationState &state, CTxAdmission &adm)
+{
+    const CTransaction &tx = adm.tx;
+    unsigned char sighashType = 0;
+    PrecomputedTransactionData txdata(tx);
+    if (!CheckInputScripts(tx, state, adm.spentCoins, STANDARD_SCRIPT_VERIFY_FLAGS | adm.forkVerifyFlags, true,
+            txdata, &adm.resourceTracker, NULL, &sighashType))
+    {
+        LogPrint("mempool", "txn CheckInputs failed");
+        return false;
+    }
+    adm.pentry->UpdateRuntimeSigOps(adm.resourceTracker.GetSigOps(), adm.resourceTracker.GetSighashBytes());
+    adm.pentry->sighashType = sighashType;
+
+    // Check again against just the consensus-critical mandatory script
+    // verification flags, in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    //
+    // This check uses the consensus flags of the next block, which include
+    // the mandatory ones, and remembers the result in the script execution
+    // cache so that ConnectBlock() can skip these scripts when the
+    // transaction is mined.
+    if (!CheckInputScripts(tx, state, adm.spentCoins,
+            MANDATORY_SCRIPT_VERIFY_FLAGS | adm.nextBlockFlags | adm.forkVerifyFlags, true, txdata, NULL))
+    {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+            __func__, adm.hash.ToString(), FormatStateMessage(state));
+    }
+    return true;
+}
+
+/**
+ * Add a transaction whose scripts passed to the mempool.  The tip must be the one it was prepared on.  If the
+ * mempool changed in the meantime the conflict, input and ancestor checks are done again.
+ */
+static bool FinishAdmission(CTxMemPool &pool,
+    CValidationState &state,
+    CTxAdmission &adm,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee)
+{
+    AssertLockHeld(cs_main);
+    assert(adm.pindexTip == chainActive.Tip());
+    const CTransaction &tx = adm.tx;
+    const uint256 &hash = adm.hash;
 
-        // trim mempool and check if tx was trimmed
-        if (!fOverrideMempoolLimit)
+    if (pool.GetTransactionsUpdated() != adm.nMempoolUpdated)
+    {
+        if (pool.exists(hash))
+            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
+
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        BOOST_FOREACH (const CTxIn &txin, tx.vin)
         {
-            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
-                GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
-            if (!pool.exists(hash))
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+            if (pool.mapNextTx.count(txin.prevout))
+                return state.Invalid(false, REJECT_CONFLICT, "txn-mempool-conflict");
+            // An unconfirmed parent may have been evicted
+            if (!viewMemPool.HaveCoin(txin.prevout))
+            {
+                if (pfMissingInputs)
+                    *pfMissingInputs = true;
+                return false;
+            }
         }
-        // BU: update tx per second when a tx is valid and accepted
-        pool.UpdateTransactionsPerSecond();
-        // BU - Xtreme Thinblocks - trim the orphan pool by entry time and do not allow it to be overidden.
+        if (!CalculateAdmissionAncestors(pool, state, adm))
+            return false;
     }
 
+    // This code denies old style tx from entering the mempool as soon as we fork
+    if (chainActive.Tip()->IsforkActiveOnNextBlock(miningForkTime.value) && !IsTxBUIP055Only(*adm.pentry))
+    {
+        return state.Invalid(false, REJECT_WRONG_FORK, "txn-uses-old-sighash-algorithm");
+    }
+    // Store transaction in memory
+    pool.addUnchecked(hash, *adm.pentry, adm.setAncestors, !IsInitialBlockDownload());
+
+    // trim mempool and check if tx was trimmed
+    if (!fOverrideMempoolLimit)
+    {
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+            GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+    }
+    // BU: update tx per second when a tx is valid and accepted
+    pool.UpdateTransactionsPerSecond();
+
     if (!fRejectAbsurdFee)
         SyncWithWallets(tx, NULL);
 
@@ -1501,13 +1607,33 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
 
     LogPrint("bench", "ValidateTransaction, time: %d, tx: %s, len: %d, sigops: %llu (legacy: %u), sighash: %llu, Vin: "
                       "%llu, Vout: %llu\n",
-        end - start, tx.GetHash().ToString(), nSize, resourceTracker.GetSigOps(), (unsigned int)nSigOps,
-        resourceTracker.GetSighashBytes(), tx.vin.size(), tx.vout.size());
-    nTxValidationTime << (end - start);
+        end - adm.nStartTime, hash.ToString(), adm.pentry->GetTxSize(), adm.resourceTracker.GetSigOps(), adm.nSigOps,
+        adm.resourceTracker.GetSighashBytes(), tx.vin.size(), tx.vout.size());
+    nTxValidationTime << (end - adm.nStartTime);
 
     return true;
 }
 
+bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransaction &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee,
+    std::vector<COutPoint> &vCoinsToUncache)
+{
+    AssertLockHeld(cs_main);
+    if (pfMissingInputs)
+        *pfMissingInputs = false;
+
+    CTxAdmission adm(tx);
+    return PreCheckAdmission(state, adm) &&
+           PrepareAdmission(pool, state, adm, fLimitFree, pfMissingInputs, fRejectAbsurdFee, vCoinsToUncache) &&
+           CheckAdmissionScripts(state, adm) &&
+           FinishAdmission(pool, state, adm, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee);
+}
+
 bool AcceptToMemoryPool(CTxMemPool &pool,
     CValidationState &state,
     const CTransaction &tx,
@@ -1528,6 +1654,53 @@ bool AcceptToMemoryPool(CTxMemPool &pool,
     return res;
 }
 
+bool ParallelAcceptToMemoryPool(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransaction &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee)
+{
+    if (pfMissingInputs)
+        *pfMissingInputs = false;
+
+    CTxAdmission adm(tx);
+    if (!PreCheckAdmission(state, adm))
+        return false;
+
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res;
+    {
+        LOCK(cs_main);
+        res = PrepareAdmission(pool, state, adm, fLimitFree, pfMissingInputs, fRejectAbsurdFee, vCoinsToUncache);
+    }
+    if (res)
+        res = CheckAdmissionScripts(state, adm);
+
+    LOCK(cs_main);
+    if (res)
+    {
+        if (adm.pindexTip == chainActive.Tip())
+            res = FinishAdmission(pool, state, adm, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee);
+        else
+        {
+            // A block came in while the scripts were checked, so the coins may be gone and the flags may differ.
+            // Start over under the lock, the script cache makes the second run of the scripts cheap.
+            state = CValidationState();
+            res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit,
+                fRejectAbsurdFee, vCoinsToUncache);
+        }
+    }
+    if (!res)
+    {
+        for (const COutPoint &remove : vCoinsToUncache)
+            pcoinsTip->Uncache(remove);
+    }
+
+    return res;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash,
     CTransaction &txOut,
@@ -1629,15 +1802,15 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    CBlockFileSpan span;
+    if (!ReadRawBlockFromDisk(span, pos, Params().MessageStart()))
+        return false;
 
     // Read block
     try
     {
-        filein >> block;
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, span.data(), span.size());
+        reader >> block;
     }
     catch (const std::exception &e)
     {
@@ -1661,6 +1834,73 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(CBlockFileSpan &span,
+    const CDiskBlockPos &pos,
+    const CMessageHeader::MessageStartChars &messageStart)
+{
+    span = CBlockFileSpan();
+    // pos is that of the block itself, the message start and size are written just before it
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("%s: No block at %s", __func__, pos.ToString());
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - nHeaderSize);
+
+    std::shared_ptr<const CMappedBlockFile> file = MapBlockFile(pos.nFile, pos.nPos);
+    if (file)
+    {
+        const unsigned char *pheader = file->data() + posHeader.nPos;
+        if (memcmp(pheader, messageStart, MESSAGE_START_SIZE))
+            return error("%s: Bad message start for block at %s", __func__, pos.ToString());
+        unsigned int nSize = ReadLE32(pheader + MESSAGE_START_SIZE);
+        if (nSize > file->size() - pos.nPos)
+        {
+            // Written after the file was mapped
+            file = MapBlockFile(pos.nFile, (size_t)pos.nPos + nSize);
+            if (!file)
+                return error("%s: Block at %s runs past the end of its file", __func__, pos.ToString());
+        }
+        span = CBlockFileSpan(file, file->data() + pos.nPos, nSize);
+        return true;
+    }
+
+    // Without a mapping the block is read into memory of its own
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    try
+    {
+        CMessageHeader::MessageStartChars start;
+        unsigned int nSize = 0;
+        filein >> FLATDATA(start) >> nSize;
+        if (memcmp(start, messageStart, MESSAGE_START_SIZE))
+            return error("%s: Bad message start for block at %s", __func__, pos.ToString());
+        std::shared_ptr<std::vector<unsigned char> > pdata = std::make_shared<std::vector<unsigned char> >(nSize);
+        filein.read((char *)pdata->data(), nSize);
+        span = CBlockFileSpan(pdata, pdata->data(), nSize);
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CBlockFileSpan &span,
+    const CBlockIndex *pindex,
+    const CMessageHeader::MessageStartChars &messageStart)
+{
+    if (!ReadRawBlockFromDisk(span, pindex->GetBlockPos(), messageStart))
+        return false;
+    // The block hash is that of its serialized header, which is all that is checked here
+    if (span.size() < 80 || Hash(span.begin(), span.begin() + 80) != pindex->GetBlockHash())
+    {
+        span = CBlockFileSpan();
+        return error("%s: Header doesn't match index for %s at %s", __func__, pindex->ToString(),
+            pindex->GetBlockPos().ToString());
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1842,11 +2082,27 @@ void UpdateCoins(const CTransaction &tx, CValidationState &state, CCoinsViewCach
     UpdateCoins(tx, state, inputs, txundo, nHeight);
 }
 
+/** Account for the coins UpdateCoins() spent and created in the UTXO set commitment */
+static void UpdateCommitment(CUTXOCommitment &commitment, const CTransaction &tx, const CTxUndo &txundo, int nHeight)
+{
+    if (!tx.IsCoinBase())
+    {
+        for (size_t j = 0; j < tx.vin.size(); j++)
+            commitment.Remove(tx.vin[j].prevout, txundo.vprevout[j]);
+    }
+    const uint256 &txid = tx.GetHash();
+    for (size_t o = 0; o < tx.vout.size(); o++)
+    {
+        if (!tx.vout[o].scriptPubKey.IsUnspendable())
+            commitment.Add(COutPoint(txid, o), Coin(tx.vout[o], nHeight, tx.IsCoinBase()));
+    }
+}
+
 bool CScriptCheck::operator()()
 {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    CachingTransactionSignatureChecker checker(ptxTo, nIn, amount, nFlags, cacheStore);
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, checker, &error, &sighashType))
+    CachingTransactionSignatureChecker checker(ptxTo, nIn, amount, *txdata, nFlags, cacheStore);
+    if (!VerifyScript(scriptSig, *scriptPubKey, nFlags, checker, &error, &sighashType))
         return false;
     if (resourceTracker)
         resourceTracker->Update(ptxTo->GetHash(), checker.GetNumSigops(), checker.GetBytesHashed());
@@ -1919,12 +2175,139 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state, const CCoins
 }
 } // namespace Consensus
 
+namespace
+{
+/**
+ * Transactions whose scripts have all been run successfully with a given set of flags, mostly filled by
+ * AcceptToMemoryPool() with the flags of the next block. Entries are SHA256(nonce || txid || flags), so
+ * that ConnectBlock() can skip the script checks of a transaction it has already seen in the mempool.
+ */
+class CScriptExecutionCache
+{
+private:
+    uint256 nonce;
+    CCuckooCache setValid;
+
+public:
+    CScriptExecutionCache(size_t nBytes) : setValid(nBytes) { GetRandBytes(nonce.begin(), 32); }
+    uint256 ComputeEntry(const uint256 &txid, unsigned int flags)
+    {
+        uint256 entry;
+        unsigned char vchFlags[4];
+        WriteLE32(vchFlags, flags);
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write(vchFlags, 4).Finalize(entry.begin());
+        return entry;
+    }
+    bool Get(const uint256 &entry, bool fErase) { return setValid.Contains(entry, fErase); }
+    void Set(const uint256 &entry) { setValid.Insert(entry); }
+};
+
+CScriptExecutionCache &GetScriptExecutionCache()
+{
+    static CScriptExecutionCache scriptExecutionCache(
+        GetArg("-maxscriptcachesize", DEFAULT_MAX_SCRIPT_CACHE_SIZE) * ((size_t)1 << 20));
+    return scriptExecutionCache;
+}
+}
+
+namespace
+{
+/**
+ * The script checks of CheckInputs(), for a transaction whose input i spends the coin getCoin(i). If pvChecks
+ * is not NULL the checks handed out refer to the scripts of those coins, so the coins must stay in place
+ * until the checks have run.
+ */
+template <typename CoinGetter>
+bool CheckInputScriptsImpl(const CTransaction &tx,
+    CValidationState &state,
+    const CoinGetter &getCoin,
+    unsigned int flags,
+    bool cacheStore,
+    const PrecomputedTransactionData &txdata,
+    ValidationResourceTracker *resourceTracker,
+    std::vector<CScriptCheck> *pvChecks,
+    unsigned char *sighashType)
+{
+    // If the scripts of this transaction already passed with these flags there is nothing left to check.
+    // The cache is skipped when the caller wants the resources or sighash types that the checks report.
+    bool fUseCache = !resourceTracker && !sighashType;
+    uint256 hashCacheEntry;
+    if (fUseCache)
+    {
+        hashCacheEntry = GetScriptExecutionCache().ComputeEntry(tx.GetHash(), flags);
+        // A block only needs the entry once, so let its slot be reused after this.
+        if (GetScriptExecutionCache().Get(hashCacheEntry, !cacheStore))
+            return true;
+    }
+
+    if (pvChecks)
+        pvChecks->reserve(pvChecks->size() + tx.vin.size());
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const Coin &coin = getCoin(i);
+        if (coin.IsSpent())
+            LogPrintf("ASSERTION: no inputs available\n");
+        assert(!coin.IsSpent());
+
+        // We very carefully only pass in things to CScriptCheck which
+        // are clearly committed. This provides
+        // a sanity check that our caching is not introducing consensus
+        // failures through additional data in, eg, the coins being
+        // spent being checked as a part of CScriptCheck.
+        const CScript &scriptPubKey = coin.out.scriptPubKey;
+        const CAmount amount = coin.out.nValue;
+
+        // Verify signature
+        if (pvChecks)
+        {
+            pvChecks->emplace_back(resourceTracker, scriptPubKey, amount, tx, i, flags, cacheStore, txdata);
+            continue;
+        }
+        CScriptCheck check(resourceTracker, scriptPubKey, amount, tx, i, flags, cacheStore, txdata);
+        if (!check())
+        {
+            if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS)
+            {
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-standard DER encodings or non-null dummy
+                // arguments; if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                CScriptCheck check2(NULL, scriptPubKey, amount, tx, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS,
+                    cacheStore, txdata);
+                if (check2())
+                    return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)",
+                                                                        ScriptErrorString(check.GetScriptError())));
+            }
+            // Failures of other flags indicate a transaction that is
+            // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+            // such nodes as they are not following the protocol. That
+            // said during an upgrade careful thought should be taken
+            // as to the correct behavior - we may want to continue
+            // peering with non-upgraded nodes even after a soft-fork
+            // super-majority vote has passed.
+            return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)",
+                                                             ScriptErrorString(check.GetScriptError())));
+        }
+        if (sighashType)
+            *sighashType = check.sighashType;
+    }
+
+    // Checks that were handed to the caller have not run yet, so only remember scripts that did.
+    if (fUseCache && cacheStore && !pvChecks)
+        GetScriptExecutionCache().Set(hashCacheEntry);
+    return true;
+}
+}
+
 bool CheckInputs(const CTransaction &tx,
     CValidationState &state,
     const CCoinsViewCache &inputs,
     bool fScriptChecks,
     unsigned int flags,
     bool cacheStore,
+    const PrecomputedTransactionData &txdata,
     ValidationResourceTracker *resourceTracker,
     std::vector<CScriptCheck> *pvChecks,
     unsigned char *sighashType)
@@ -1933,8 +2316,6 @@ bool CheckInputs(const CTransaction &tx,
     {
         if (!Consensus::CheckTxInputs(tx, state, inputs))
             return false;
-        if (pvChecks)
-            pvChecks->reserve(tx.vin.size());
 
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
@@ -1948,65 +2329,33 @@ bool CheckInputs(const CTransaction &tx,
         // this optimisation would allow an invalid chain to be accepted.
         if (fScriptChecks)
         {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
-            {
-                const COutPoint &prevout = tx.vin[i].prevout;
-                const Coin &coin = inputs.AccessCoin(prevout);
-                if (coin.IsSpent())
-                    LogPrintf("ASSERTION: no inputs available\n");
-                assert(!coin.IsSpent());
-
-                // We very carefully only pass in things to CScriptCheck which
-                // are clearly committed. This provides
-                // a sanity check that our caching is not introducing consensus
-                // failures through additional data in, eg, the coins being
-                // spent being checked as a part of CScriptCheck.
-                const CScript &scriptPubKey = coin.out.scriptPubKey;
-                const CAmount amount = coin.out.nValue;
-
-                // Verify signature
-                CScriptCheck check(resourceTracker, scriptPubKey, amount, tx, i, flags, cacheStore);
-                if (pvChecks)
-                {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                }
-                else if (!check())
-                {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS)
-                    {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check2(NULL, scriptPubKey, amount, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
-                        if (check2())
-                            return state.Invalid(
-                                false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)",
-                                                               ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after a soft-fork
-                    // super-majority vote has passed.
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)",
-                                                                     ScriptErrorString(check.GetScriptError())));
-                }
-                if (sighashType)
-                    *sighashType = check.sighashType;
-            }
+            auto getCoin = [&tx, &inputs](unsigned int i) -> const Coin &
+            {
+                return inputs.AccessCoin(tx.vin[i].prevout);
+            };
+            return CheckInputScriptsImpl(
+                tx, state, getCoin, flags, cacheStore, txdata, resourceTracker, pvChecks, sighashType);
         }
     }
 
     return true;
 }
 
+bool CheckInputScripts(const CTransaction &tx,
+    CValidationState &state,
+    const std::vector<Coin> &spentCoins,
+    unsigned int flags,
+    bool cacheStore,
+    const PrecomputedTransactionData &txdata,
+    ValidationResourceTracker *resourceTracker,
+    std::vector<CScriptCheck> *pvChecks,
+    unsigned char *sighashType)
+{
+    assert(spentCoins.size() == tx.vin.size());
+    auto getCoin = [&spentCoins](unsigned int i) -> const Coin & { return spentCoins[i]; };
+    return CheckInputScriptsImpl(tx, state, getCoin, flags, cacheStore, txdata, resourceTracker, pvChecks, sighashType);
+}
+
 namespace
 {
 bool UndoWriteToDisk(const CBlockUndo &blockundo,
@@ -2156,6 +2505,9 @@ static DisconnectResult DisconnectBlock(const CBlock &block, const CBlockIndex *
         return DISCONNECT_FAILED;
     }
 
+    CUTXOCommitment commitment;
+    bool fCommitment = view.GetCommitment(commitment);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--)
     {
@@ -2175,6 +2527,8 @@ static DisconnectResult DisconnectBlock(const CBlock &block, const CBlockIndex *
                 {
                     fClean = false; // transaction output mismatch
                 }
+                if (fCommitment && !coin.IsSpent())
+                    commitment.Remove(out, coin);
             }
         }
 
@@ -2194,6 +2548,11 @@ static DisconnectResult DisconnectBlock(const CBlock &block, const CBlockIndex *
                 if (res == DISCONNECT_FAILED)
                     return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
+                // An unclean restore overwrote a coin we know nothing about, so the commitment is lost
+                if (res == DISCONNECT_UNCLEAN)
+                    fCommitment = false;
+                else if (fCommitment)
+                    commitment.Add(out, view.AccessCoin(out));
             }
             // At this point, all of txundo.vprevout should have been moved out.
         }
@@ -2201,6 +2560,8 @@ static DisconnectResult DisconnectBlock(const CBlock &block, const CBlockIndex *
 
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
+    if (fCommitment)
+        view.SetCommitment(commitment);
 
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
@@ -2215,7 +2576,10 @@ void static FlushBlockFile(bool fFinalize = false)
     if (fileOld)
     {
         if (fFinalize)
+        {
+            UnmapBlockFile(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2331,30 +2695,91 @@ class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
 private:
     int bit;
 
-public:
-    WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
-    int64_t BeginTime(const Consensus::Params &params) const { return 0; }
-    int64_t EndTime(const Consensus::Params &params) const { return std::numeric_limits<int64_t>::max(); }
-    int Period(const Consensus::Params &params) const { return params.nMinerConfirmationWindow; }
-    int Threshold(const Consensus::Params &params) const { return params.nRuleChangeActivationThreshold; }
-    bool Condition(const CBlockIndex *pindex, const Consensus::Params &params) const
+public:
+    WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+    int64_t BeginTime(const Consensus::Params &params) const { return 0; }
+    int64_t EndTime(const Consensus::Params &params) const { return std::numeric_limits<int64_t>::max(); }
+    int Period(const Consensus::Params &params) const { return params.nMinerConfirmationWindow; }
+    int Threshold(const Consensus::Params &params) const { return params.nRuleChangeActivationThreshold; }
+    bool Condition(const CBlockIndex *pindex, const Consensus::Params &params) const
+    {
+        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
+               ((pindex->nVersion >> bit) & 1) != 0 &&
+               ((UnlimitedComputeBlockVersion(pindex->pprev, params, pindex->nTime) >> bit) & 1) == 0;
+    }
+};
+
+// Protected by cs_main
+static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
+
+static int64_t nTimeCheck = 0;
+static int64_t nTimeForks = 0;
+static int64_t nTimeVerify = 0;
+static int64_t nTimeConnect = 0;
+static int64_t nTimeIndex = 0;
+static int64_t nTimeCallbacks = 0;
+static int64_t nTimeTotal = 0;
+
+uint32_t GetBlockScriptFlags(const CBlockIndex *pindexPrev,
+    int32_t nVersion,
+    int64_t nTime,
+    const CChainParams &chainparams,
+    int *pnLockTimeFlags)
+{
+    // BIP16 didn't become active until Apr 1 2012
+    int64_t nBIP16SwitchTime = 1333238400;
+    bool fStrictPayToScriptHash = (nTime >= nBIP16SwitchTime);
+
+    uint32_t flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // The fork is active in a block once the median time past of its parent has reached the fork time
+    if (miningForkTime.value != 0 && pindexPrev && pindexPrev->GetMedianTimePast() >= miningForkTime.value)
+    {
+        flags |= SCRIPT_VERIFY_STRICTENC;
+        flags |= SCRIPT_ENABLE_SIGHASH_FORKID;
+    }
+
+    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
+    // when 75% of the network has upgraded:
+    if (nVersion >= 3 &&
+        IsSuperMajority(3, pindexPrev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
+    {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
+    // blocks, when 75% of the network has upgraded:
+    if (nVersion >= 4 &&
+        IsSuperMajority(4, pindexPrev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
     {
-        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
-               ((pindex->nVersion >> bit) & 1) != 0 &&
-               ((UnlimitedComputeBlockVersion(pindex->pprev, params, pindex->nTime) >> bit) & 1) == 0;
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
     }
-};
 
-// Protected by cs_main
-static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
+    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    int nLockTimeFlags = 0;
+    if (VersionBitsState(pindexPrev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_CSV, versionbitscache) ==
+        THRESHOLD_ACTIVE)
+    {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+        nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
+    }
 
-static int64_t nTimeCheck = 0;
-static int64_t nTimeForks = 0;
-static int64_t nTimeVerify = 0;
-static int64_t nTimeConnect = 0;
-static int64_t nTimeIndex = 0;
-static int64_t nTimeCallbacks = 0;
-static int64_t nTimeTotal = 0;
+// If the Cash HF is enabled, we start rejecting transaction that use a high
+// s in their signature. We also make sure that signature that are supposed
+// to fail (for instance in multisig or other forms of smart contracts) are
+// null.
+#ifdef BITCOIN_CASH
+    if (IsCashHFEnabled(chainparams, pindexPrev))
+    {
+        flags |= SCRIPT_VERIFY_LOW_S;
+        flags |= SCRIPT_VERIFY_NULLFAIL;
+    }
+#endif
+
+    if (pnLockTimeFlags)
+        *pnLockTimeFlags = nLockTimeFlags;
+    return flags;
+}
 
 bool ConnectBlock(const CBlock &block,
     CValidationState &state,
@@ -2464,57 +2889,15 @@ bool ConnectBlock(const CBlock &block,
     int64_t nBIP16SwitchTime = 1333238400;
     bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
 
-    uint32_t flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    if (pindex->forkActivated(miningForkTime.value))
-    {
-        flags |= SCRIPT_VERIFY_STRICTENC;
-        flags |= SCRIPT_ENABLE_SIGHASH_FORKID;
-    }
-
-    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
-    // when 75% of the network has upgraded:
-    if (block.nVersion >= 3 && IsSuperMajority(3, pindex->pprev,
-                                   chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
-    {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
-    // blocks, when 75% of the network has upgraded:
-    if (block.nVersion >= 4 && IsSuperMajority(4, pindex->pprev,
-                                   chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
-    {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
-
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
     int nLockTimeFlags = 0;
-    if (VersionBitsState(pindex->pprev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_CSV, versionbitscache) ==
-        THRESHOLD_ACTIVE)
-    {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
-        nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
-    }
-
-// If the Cash HF is enabled, we start rejecting transaction that use a high
-// s in their signature. We also make sure that signature that are supposed
-// to fail (for instance in multisig or other forms of smart contracts) are
-// null.
-#ifdef BITCOIN_CASH
-    if (IsCashHFEnabled(chainparams, pindex->pprev))
-    {
-        flags |= SCRIPT_VERIFY_LOW_S;
-        flags |= SCRIPT_VERIFY_NULLFAIL;
-    }
-#endif
+    uint32_t flags =
+        GetBlockScriptFlags(pindex->pprev, block.nVersion, pindex->GetBlockTime(), chainparams, &nLockTimeFlags);
 
     int64_t nTime2 = GetTimeMicros();
     nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
-    ValidationResourceTracker resourceTracker;
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
@@ -2527,6 +2910,10 @@ bool ConnectBlock(const CBlock &block,
     int nOrphansChecked = 0;
     const arith_uint256 nStartingChainWork = chainActive.Tip()->nChainWork;
 
+    // The UTXO set commitment is brought along when the block is really connected, as long as it is known
+    CUTXOCommitment commitment;
+    bool fCommitment = !fJustCheck && view.GetCommitment(commitment);
+
     // Create a vector for storing hashes that will be deleted from the unverified and perverified txn sets.
     // We will delete these hashes only if and when this block is the one that is accepted saving us the unnecessary
     // repeated locking and unlocking of cs_xval.
@@ -2539,6 +2926,12 @@ bool ConnectBlock(const CBlock &block,
     // with the mutex so that the checking of inputs can be done with the chosen scriptcheckqueue.
     CCheckQueue<CScriptCheck> *pScriptQueue(PV->GetScriptCheckQueue());
 
+    // Precomputed sighash data for each transaction whose inputs are checked. Script checks hold pointers into
+    // this vector, so it is reserved up front to prevent reallocation and declared before the queue control
+    // so that it outlives any checks still in flight.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+
     // Aquire the control that is used to wait for the script threads to finish. Do this after aquiring the
     // scoped lock to ensure the scriptqueue is free and available.
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && PV->ThreadCount() ? pScriptQueue : NULL);
@@ -2563,6 +2956,11 @@ bool ConnectBlock(const CBlock &block,
         // Start checking Inputs
         bool inOrphanCache;
         bool inVerifiedCache;
+        bool fCheckScripts = false;
+        // Reused for every transaction, so that handing its checks to the queue does not allocate once it has grown
+        std::vector<CScriptCheck> vChecks;
+        uint64_t nScriptChecks = 0;
+        uint64_t nScriptCheckAllocs = 0;
         // When in parallel mode then unlock cs_main for this loop to give any other threads
         // a chance to process in parallel. This is crucial for parallel validation to work.
         // NOTE: the only place where cs_main is needed is if we hit PV->ChainWorkHasChanged, which
@@ -2639,16 +3037,12 @@ bool ConnectBlock(const CBlock &block,
                         if (inOrphanCache)
                             nOrphansChecked++;
 
-                        std::vector<CScriptCheck> vChecks;
-                        bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks
-                                                            (still consult the cache, though) */
-                        if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, &resourceTracker,
-                                PV->ThreadCount() ? &vChecks : NULL))
+                        if (!Consensus::CheckTxInputs(tx, state, view))
                         {
                             return error("ConnectBlock(): CheckInputs on %s failed with %s", tx.GetHash().ToString(),
                                 FormatStateMessage(state));
                         }
-                        control.Add(vChecks);
+                        fCheckScripts = fScriptChecks;
                         nChecked++;
                     }
                     else
@@ -2663,7 +3057,45 @@ bool ConnectBlock(const CBlock &block,
             {
                 blockundo.vtxundo.push_back(CTxUndo());
             }
-            UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+            CTxUndo &txundo = i == 0 ? undoDummy : blockundo.vtxundo.back();
+            if (fCommitment && !fEnforceBIP30 && tx.IsCoinBase())
+            {
+                // Without BIP30 a coinbase can overwrite an unspent output of an earlier duplicate
+                for (size_t o = 0; o < tx.vout.size(); o++)
+                {
+                    if (tx.vout[o].scriptPubKey.IsUnspendable())
+                        continue;
+                    COutPoint out(tx.GetHash(), o);
+                    const Coin &coin = view.AccessCoin(out);
+                    if (!coin.IsSpent())
+                        commitment.Remove(out, coin);
+                }
+            }
+            UpdateCoins(tx, state, view, txundo, pindex->nHeight);
+            if (fCommitment)
+                UpdateCommitment(commitment, tx, txundo, pindex->nHeight);
+
+            // The coins spent by this transaction now sit in the block's undo data, which is reserved up front and
+            // not modified again before the script checks are done. So the checks can refer to their scripts.
+            if (fCheckScripts)
+            {
+                bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks
+                                                    (still consult the cache, though) */
+                size_t nCapacity = vChecks.capacity();
+                txdata.emplace_back(tx);
+                if (!CheckInputScripts(tx, state, txundo.vprevout, flags, fCacheResults, txdata.back(), NULL,
+                        PV->ThreadCount() ? &vChecks : NULL))
+                {
+                    return error("ConnectBlock(): CheckInputs on %s failed with %s", tx.GetHash().ToString(),
+                        FormatStateMessage(state));
+                }
+                nScriptChecks += vChecks.size();
+                if (vChecks.capacity() != nCapacity)
+                    nScriptCheckAllocs++;
+                control.Add(vChecks);
+                vChecks.clear();
+                fCheckScripts = false;
+            }
             vPos.push_back(std::make_pair(tx.GetHash(), pos));
             pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
 
@@ -2687,6 +3119,15 @@ bool ConnectBlock(const CBlock &block,
             // if we end up here then the signature verification failed and we must re-lock cs_main before returning.
             return state.DoS(100, false);
         }
+        if (fScriptChecks && PV->ThreadCount())
+        {
+            nScriptCheckQueueDepth << pScriptQueue->GetLastMaxDepth();
+            nScriptCheckSteals << pScriptQueue->GetLastSteals();
+            nScriptCheckCount << nScriptChecks;
+            nScriptCheckAllocations << nScriptCheckAllocs;
+        }
+        if (fScriptChecks)
+            UpdateSignatureCacheStats();
         if (PV->QuitReceived(this_id, fParallel))
         {
             return false;
@@ -2765,6 +3206,8 @@ bool ConnectBlock(const CBlock &block,
 
     // add this block to the view's block chain (the main UTXO in memory cache)
     view.SetBestBlock(pindex->GetBlockHash());
+    if (fCommitment)
+        view.SetCommitment(commitment);
 
     int64_t nTime5 = GetTimeMicros();
     nTimeIndex += nTime5 - nTime4;
@@ -2794,6 +3237,14 @@ bool ConnectBlock(const CBlock &block,
     return true;
 }
 
+/** Write the databases in their initial block download mode for as long as it lasts, see CDBWrapper::SetIBDMode() */
+static void UpdateDatabaseWriteMode()
+{
+    bool fIBD = IsInitialBlockDownload();
+    pblocktree->SetIBDMode(fIBD);
+    pcoinsdbview->GetDB().SetIBDMode(fIBD);
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2811,6 +3262,7 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
     bool fFlushForPrune = false;
     try
     {
+        UpdateDatabaseWriteMode();
         if (fPruneMode && fCheckForPruning && !fReindex)
         {
             FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
@@ -2897,9 +3349,20 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
+            // In IBD mode the block index was written without syncing, and it must be on disk before the
+            // chainstate that refers to it
+            if (!pblocktree->Checkpoint())
+                return AbortNode(state, "Failed to sync the block index database");
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Normally the coins are written in the background while we carry on connecting blocks.  Callers
+            // asking for everything to be on disk, and pruning, which must not run ahead of the chainstate on
+            // disk, wait for the write to finish.
+            if (pcoinsflusher && (mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsflusher->WaitForWrite())
+                return AbortNode(state, "Failed to write to coin database");
+            if (mode == FLUSH_STATE_ALWAYS && !pcoinsdbview->GetDB().Checkpoint())
+                return AbortNode(state, "Failed to sync the coin database");
             nLastFlush = nNow;
             // Trim any excess entries from the cache if needed.  If chain is not syncd then
             // trim extra so that we don't flush as often during IBD.
@@ -3132,6 +3595,14 @@ bool static ConnectTip(CValidationState &state,
     LogPrint(
         "bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
+        // Warm the coins cache with the block's inputs in parallel rather than reading them from the
+        // database one at a time while connecting the block. The genesis block is connected before
+        // parallel validation has been set up.
+        if (PV)
+            PV->PrefetchInputs(*pblock, pcoinsTip);
+        int64_t nTimePrefetch = GetTimeMicros();
+        LogPrint("bench", "  - Prefetch inputs: %.2fms\n", (nTimePrefetch - nTime2) * 0.001);
+
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fParallel);
         GetMainSignals().BlockChecked(*pblock, state);
@@ -3746,6 +4217,112 @@ bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex)
     return true;
 }
 
+bool ActivateUTXOSnapshot(const fs::path &path, CValidationState &state)
+{
+    const CChainParams &chainparams = Params();
+    CUTXOSnapshotHeader header;
+    uint64_t nCoins = 0;
+    uint256 hashFile;
+    // Reading through the whole file takes a while, so do it before taking cs_main
+    if (!VerifyUTXOSnapshot(path, header, nCoins, hashFile))
+        return state.Error("invalid UTXO snapshot");
+
+    if (PV)
+    {
+        PV->StopAllValidationThreads();
+        PV->WaitForAllValidationThreadsToStop();
+    }
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(header.hashBaseBlock);
+        if (mi == mapBlockIndex.end())
+            return state.Error("the header of the snapshot base block is not known yet");
+        CBlockIndex *pindexBase = mi->second;
+        // The header chain is all that vouches for the snapshot, so its base must be on the best one
+        if (!pindexBase->IsValid(BLOCK_VALID_TREE) || pindexBestHeader == NULL ||
+            pindexBestHeader->GetAncestor(pindexBase->nHeight) != pindexBase)
+            return state.Error("the snapshot base block is not on the best header chain");
+        if (chainActive.Height() >= pindexBase->nHeight ||
+            pindexBase->GetAncestor(chainActive.Height()) != chainActive.Tip())
+            return state.Error("the active chain is already past the snapshot base block");
+
+        if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+            return false;
+        // Everything left in the cache is unmodified and about to be stale
+        pcoinsTip->Trim(0);
+        mempool.clear();
+        CUTXOCommitment commitment;
+        if (!LoadUTXOSnapshot(path, pcoinsdbview, header, nCoins, commitment))
+            return AbortNode(state, "Failed to load UTXO snapshot, the coin database must be rebuilt with -reindex");
+        pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+        pcoinsTip->SetCommitment(commitment);
+
+        // The blocks up to the base now count as connected.  Those we never downloaded are marked, and get
+        // a placeholder transaction count so that the blocks after them can be linked.
+        std::vector<CBlockIndex *> vChain(pindexBase->nHeight + 1);
+        for (CBlockIndex *pindex = pindexBase; pindex; pindex = pindex->pprev)
+            vChain[pindex->nHeight] = pindex;
+        std::deque<CBlockIndex *> queue;
+        BOOST_FOREACH (CBlockIndex *pindex, vChain)
+        {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            {
+                pindex->nStatus |= BLOCK_ASSUMED_VALID;
+                if (pindex->nTx == 0)
+                    pindex->nTx = 1;
+            }
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Blocks we already have that were waiting for this one can be linked now
+            std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
+                range = mapBlocksUnlinked.equal_range(pindex);
+            while (range.first != range.second)
+            {
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator it = range.first++;
+                if (pindexBase->GetAncestor(it->second->nHeight) != it->second)
+                    queue.push_back(it->second);
+                mapBlocksUnlinked.erase(it);
+            }
+        }
+        chainActive.SetTip(pindexBase);
+        setBlockIndexCandidates.insert(pindexBase);
+        while (!queue.empty())
+        {
+            CBlockIndex *pindex = queue.front();
+            queue.pop_front();
+            pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+            {
+                LOCK(cs_nBlockSequenceId);
+                pindex->nSequenceId = nBlockSequenceId++;
+            }
+            if (!setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip()))
+                setBlockIndexCandidates.insert(pindex);
+            std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
+                range = mapBlocksUnlinked.equal_range(pindex);
+            while (range.first != range.second)
+            {
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator it = range.first++;
+                queue.push_back(it->second);
+                mapBlocksUnlinked.erase(it);
+            }
+        }
+        PruneBlockIndexCandidates();
+
+        if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+            return false;
+        LogPrintf("%s: chain state set to height %d from UTXO snapshot %s (%u coins, checksum %s)\n", __func__,
+            pindexBase->nHeight, path.string(), nCoins, hashFile.ToString());
+    }
+    uiInterface.NotifyBlockTip(IsInitialBlockDownload(), chainActive.Tip());
+
+    // Connect any blocks after the base that we already have
+    return ActivateBestChain(state, chainparams);
+}
+
 CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
 {
     // Check for duplicate
@@ -3755,8 +4332,7 @@ CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex *pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex *pindexNew = poolBlockIndex.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3967,6 +4543,26 @@ bool CheckBlockHeader(const CBlockHeader &block, CValidationState &state, bool f
     return true;
 }
 
+size_t CheckBlockTransactions(const CBlock &block,
+    size_t nBegin,
+    size_t nEnd,
+    CValidationState &state,
+    uint64_t &nSigOps,
+    uint64_t &nLargestTx)
+{
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        if (!CheckTransaction(tx, state))
+            return i;
+        nSigOps += GetLegacySigOpCount(tx);
+        uint64_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nTxSize > nLargestTx)
+            nLargestTx = nTxSize;
+    }
+    return nEnd;
+}
+
 bool CheckBlock(const CBlock &block, CValidationState &state, bool fCheckPOW, bool fCheckMerkleRoot, bool fConservative)
 {
     // These are checks that are independent of context.
@@ -3983,7 +4579,7 @@ bool CheckBlock(const CBlock &block, CValidationState &state, bool fCheckPOW, bo
     if (fCheckMerkleRoot)
     {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2 = PV ? PV->BlockMerkleRoot(block, &mutated) : BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(
                 100, error("CheckBlock(): hashMerkleRoot mismatch"), REJECT_INVALID, "bad-txnmrklroot", true);
@@ -4016,25 +4612,17 @@ bool CheckBlock(const CBlock &block, CValidationState &state, bool fCheckPOW, bo
         if (block.vtx[i].IsCoinBase())
             return state.DoS(100, error("CheckBlock(): more than one coinbase"), REJECT_INVALID, "bad-cb-multiple");
 
-    // Check transactions
-    BOOST_FOREACH (const CTransaction &tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock(): CheckTransaction of %s failed with %s", tx.GetHash().ToString(),
-                FormatStateMessage(state));
-
+    // Check transactions, large blocks have them checked on several threads
     uint64_t nSigOps = 0;
-    // BU: count the number of transactions in case the CheckExcessive function wants to use this as criteria
-    uint64_t nTx = 0;
     uint64_t nLargestTx = 0; // BU: track the longest transaction
+    size_t nFailed = PV ? PV->CheckBlockTransactions(block, state, nSigOps, nLargestTx) :
+                          CheckBlockTransactions(block, 0, block.vtx.size(), state, nSigOps, nLargestTx);
+    if (nFailed < block.vtx.size())
+        return error("CheckBlock(): CheckTransaction of %s failed with %s", block.vtx[nFailed].GetHash().ToString(),
+            FormatStateMessage(state));
 
-    BOOST_FOREACH (const CTransaction &tx, block.vtx)
-    {
-        nTx++;
-        nSigOps += GetLegacySigOpCount(tx);
-        uint64_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-        if (nTxSize > nLargestTx)
-            nLargestTx = nTxSize;
-    }
+    // BU: count the number of transactions in case the CheckExcessive function wants to use this as criteria
+    uint64_t nTx = block.vtx.size();
 
     // BU only enforce sigops during block generation not acceptance
     if (fConservative && (nSigOps > BLOCKSTREAM_CORE_MAX_BLOCK_SIGOPS))
@@ -4526,6 +5114,8 @@ void UnlinkPrunedFiles(std::set<int> &setFilesToPrune)
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it)
     {
         CDiskBlockPos pos(*it, 0);
+        // Blocks already read from the file stay mapped until their readers are done with them
+        UnmapBlockFile(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4639,9 +5229,7 @@ CBlockIndex *InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex(): new CBlockIndex failed");
+    CBlockIndex *pindexNew = poolBlockIndex.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4808,6 +5396,12 @@ bool CVerifyDB::VerifyDB(const CChainParams &chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        if (pindex->nStatus & BLOCK_ASSUMED_VALID)
+        {
+            LogPrintf("VerifyDB(): block verification stopping at height %d (loaded from UTXO snapshot, no data)\n",
+                pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -4918,11 +5512,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH (BlockMap::value_type &entry, mapBlockIndex)
-    {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    poolBlockIndex.Clear();
     fHavePruned = false;
 }
 
@@ -4981,15 +5572,146 @@ bool InitBlockIndex(const CChainParams &chainparams)
     return true;
 }
 
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/** Process a block read by LoadExternalBlockFile, and any earlier ones that were waiting for it as their
+ *  parent.  Returns false if the import has to stop.
+ */
+static bool ImportBlock(const CChainParams &chainparams, CBlock &block, CDiskBlockPos *dbp, int &nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+        mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end())
+    {
+        LogPrint("reindex", "%s: Out of order block %s (created %s), parent %s not known\n", __func__,
+            hash.ToString(), DateTimeStrFormat("%Y-%m-%d", block.nTime), block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
+    {
+        CValidationState state;
+        if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp, false))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    }
+    else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+             mapBlockIndex[hash]->nHeight % 1000 == 0)
+    {
+        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(),
+            mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty())
+    {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator,
+            std::multimap<uint256, CDiskBlockPos>::iterator>
+            range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second)
+        {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__,
+                    block.GetHash().ToString(), head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, chainparams, NULL, &block, true, &it->second, false))
+                {
+                    nLoaded++;
+                    queue.push_back(block.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
+/** LoadExternalBlockFile for one of our own block files, reading the blocks straight out of its mapping */
+static void LoadMappedBlockFile(const CChainParams &chainparams,
+    const CMappedBlockFile &file,
+    CDiskBlockPos *dbp,
+    int &nLoaded)
+{
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    size_t nPos = dbp->nPos;
+    while (nPos + nHeaderSize <= file.size())
+    {
+        boost::this_thread::interruption_point();
+
+        // locate a header
+        const unsigned char *pheader =
+            (const unsigned char *)memchr(file.data() + nPos, chainparams.MessageStart()[0], file.size() - nPos);
+        if (!pheader)
+            break;
+        nPos = pheader - file.data();
+        if (nPos + nHeaderSize > file.size())
+            break;
+        if (memcmp(pheader, chainparams.MessageStart(), MESSAGE_START_SIZE))
+        {
+            nPos++;
+            continue;
+        }
+        unsigned int nSize = ReadLE32(pheader + MESSAGE_START_SIZE);
+        if (nSize < 80)
+        {
+            LogPrint("reindex", "Reindex error: Short block: %d\n", nSize);
+            nPos++;
+            continue;
+        }
+
+        try
+        {
+            // read block
+            dbp->nPos = nPos + nHeaderSize;
+            size_t nLimit = std::min<size_t>(nSize, file.size() - dbp->nPos);
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, file.data() + dbp->nPos, nLimit);
+            CBlock block;
+            reader >> block;
+            nPos = dbp->nPos + nLimit - reader.size();
+            if (!ImportBlock(chainparams, block, dbp, nLoaded))
+                break;
+        }
+        catch (const std::exception &e)
+        {
+            LogPrintf("%s: Deserialize error - %s\n", __func__, e.what());
+            // start one byte further, in case of failure
+            nPos++;
+        }
+    }
+}
+
 bool LoadExternalBlockFile(const CChainParams &chainparams, FILE *fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try
     {
+        // Our own block files are read without copying them through a buffer, where they can be mapped
+        std::shared_ptr<const CMappedBlockFile> file = dbp ? MapBlockFile(dbp->nFile, 0) : nullptr;
+        if (file)
+        {
+            fclose(fileIn);
+            LoadMappedBlockFile(chainparams, *file, dbp, nLoaded);
+            if (nLoaded > 0)
+                LogPrintf("Loaded %i blocks from block file %d in %dms\n", nLoaded, dbp->nFile,
+                    GetTimeMillis() - nStart);
+            return nLoaded > 0;
+        }
+
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * (reindexTypicalBlockSize.value + MESSAGE_START_SIZE + sizeof(unsigned int)),
             reindexTypicalBlockSize.value + MESSAGE_START_SIZE + sizeof(unsigned int), SER_DISK, CLIENT_VERSION);
@@ -5047,62 +5769,8 @@ bool LoadExternalBlockFile(const CChainParams &chainparams, FILE *fileIn, CDiskB
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                    mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end())
-                {
-                    LogPrint("reindex", "%s: Out of order block %s (created %s), parent %s not known\n", __func__,
-                        hash.ToString(), DateTimeStrFormat("%Y-%m-%d", block.nTime), block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
-                {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp, false))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                }
-                else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                         mapBlockIndex[hash]->nHeight % 1000 == 0)
-                {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(),
-                        mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty())
-                {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator,
-                        std::multimap<uint256, CDiskBlockPos>::iterator>
-                        range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second)
-                    {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__,
-                                block.GetHash().ToString(), head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, chainparams, NULL, &block, true, &it->second, false))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
+                if (!ImportBlock(chainparams, block, dbp, nLoaded))
+                    break;
             }
             catch (const std::exception &e)
             {
@@ -5173,7 +5841,8 @@ void static CheckBlockIndex(const Consensus::Params &consensusParams)
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID)
             pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA))
+        // Blocks taken from a UTXO snapshot never had data, but count as processed
+        if (pindexFirstMissing == NULL && !(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)))
             pindexFirstMissing = pindex;
         if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0)
             pindexFirstNeverProcessed = pindex;
@@ -5205,7 +5874,7 @@ void static CheckBlockIndex(const Consensus::Params &consensusParams)
         if (!fHavePruned)
         {
             // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
-            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(!(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)) == (pindex->nTx == 0));
             assert(pindexFirstMissing == pindexFirstNeverProcessed);
         }
         else
@@ -5572,9 +6241,19 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                    // Send block from disk, or from the blocks recently sent to other peers.  Full blocks go out
+                    // exactly as they are stored, the other kinds have to be built from the deserialized block.
+                    std::shared_ptr<const CBlock> pblock;
+                    CBlockFileSpan span;
+                    bool fRead;
+                    if (inv.type == MSG_BLOCK)
+                        fRead = ReadServedRawBlock(span, (*mi).second, Params().MessageStart());
+                    else
+                    {
+                        pblock = ReadServedBlock((*mi).second, consensusParams);
+                        fRead = (pblock != nullptr);
+                    }
+                    if (!fRead)
                     {
                         // its possible that I know about it but haven't stored it yet
                         LogPrint("thin", "unable to load block %s from disk\n",
@@ -5586,14 +6265,14 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                         if (inv.type == MSG_BLOCK)
                         {
                             pfrom->blocksSent += 1;
-                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                            pfrom->PushMessage(NetMsgType::BLOCK, CFlatData((void *)span.begin(), (void *)span.end()));
                         }
 
                         // BUIP010 Xtreme Thinblocks: begin section
                         else if (inv.type == MSG_THINBLOCK || inv.type == MSG_XTHINBLOCK)
                         {
                             LogPrint("thin", "Sending xthin by INV queue getdata message\n");
-                            SendXThinBlock(block, pfrom, inv);
+                            SendXThinBlock(*pblock, pfrom, inv);
                         }
                         // BUIP010 Xtreme Thinblocks: end section
 
@@ -5602,6 +6281,7 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                             LOCK(pfrom->cs_filter);
                             if (pfrom->pfilter)
                             {
+                                const CBlock &block = *pblock;
                                 CMerkleBlock merkleBlock(block, *pfrom->pfilter);
                                 pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
                                 pfrom->blocksSent += 1;
@@ -6730,9 +7410,8 @@ bool ProcessMessage(CNode *pfrom, std::string strCommand, CDataStream &vRecv, in
                     inv.hash.ToString());
             }
 
-            CBlock block;
-            const Consensus::Params &consensusParams = Params().GetConsensus();
-            if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+            std::shared_ptr<const CBlock> pblock = ReadServedBlock((*mi).second, Params().GetConsensus());
+            if (!pblock)
             {
                 // We don't have the block yet, although we know about it.
                 return error("Peer %s (%d) requested block %s that cannot be read", pfrom->addrName.c_str(), pfrom->id,
@@ -6740,7 +7419,7 @@ bool ProcessMessage(CNode *pfrom, std::string strCommand, CDataStream &vRecv, in
             }
             else
             {
-                SendXThinBlock(block, pfrom, inv);
+                SendXThinBlock(*pblock, pfrom, inv);
             }
         }
     }
@@ -7773,10 +8452,8 @@ void MainCleanup()
     {
         LOCK(cs_main); // BU apply the appropriate lock so no contention during destruction
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        poolBlockIndex.Clear();
     }
 
     if (1)
@@ -36,6 +36,7 @@
 
 class ValidationResourceTracker;
 class CBlockIndex;
+class CBlockFileSpan;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
@@ -48,10 +49,14 @@ class CValidationState;
 
 struct CNodeStateStats;
 struct LockPoints;
+struct PrecomputedTransactionData;
 
 /** Global variable that points to the coins database */
 extern CCoinsViewDB *pcoinsdbview;
 
+/** Global variable that points to the background writer in front of pcoinsdbview, if -backgroundflush is on */
+extern CCoinsViewBackgroundFlush *pcoinsflusher;
+
 enum FlushStateMode
 {
     FLUSH_STATE_NONE,
@@ -97,6 +102,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -maxscriptcachesize default, in MiB, for the cache of transactions whose scripts passed (32 bytes per entry) */
+static const unsigned int DEFAULT_MAX_SCRIPT_CACHE_SIZE = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 // static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which we must receive a VERACK message after having first sent a VERSION message */
@@ -160,6 +167,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex *, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Where the entries of mapBlockIndex are allocated */
+extern CBlockIndexPool poolBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -356,6 +365,19 @@ bool AcceptToMemoryPool(CTxMemPool &pool,
     bool fOverrideMempoolLimit = false,
     bool fRejectAbsurdFee = false);
 
+/**
+ * Like AcceptToMemoryPool, but to be called without cs_main held.  The lock is only taken to check the
+ * transaction against the chain and the mempool and to add it, its scripts are checked in between without it,
+ * so several threads can admit transactions at the same time.
+ */
+bool ParallelAcceptToMemoryPool(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransaction &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit = false,
+    bool fRejectAbsurdFee = false);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -390,7 +412,9 @@ unsigned int GetP2SHSigOpCount(const CTransaction &tx, const CCoinsViewCache &ma
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. In that case txdata must stay alive until the checks have run.
+ * Unless resourceTracker or sighashType are requested, scripts that already passed with the same flags
+ * are not run again, and if cacheStore is set and the scripts ran inline their success is remembered.
  */
 bool CheckInputs(const CTransaction &tx,
     CValidationState &state,
@@ -398,10 +422,36 @@ bool CheckInputs(const CTransaction &tx,
     bool fScriptChecks,
     unsigned int flags,
     bool cacheStore,
+    const PrecomputedTransactionData &txdata,
     ValidationResourceTracker *resourceTracker,
     std::vector<CScriptCheck> *pvChecks = NULL,
     unsigned char *sighashType = NULL);
 
+/**
+ * Check the scripts of all inputs of this transaction like CheckInputs() does, given the coins they spend in
+ * input order. If pvChecks is not NULL the checks pushed onto it refer to the scripts in spentCoins, which must
+ * not be modified or moved until the checks have run.
+ */
+bool CheckInputScripts(const CTransaction &tx,
+    CValidationState &state,
+    const std::vector<Coin> &spentCoins,
+    unsigned int flags,
+    bool cacheStore,
+    const PrecomputedTransactionData &txdata,
+    ValidationResourceTracker *resourceTracker,
+    std::vector<CScriptCheck> *pvChecks = NULL,
+    unsigned char *sighashType = NULL);
+
+
+/**
+ * The script verification flags for a block with version nVersion and time nTime on top of pindexPrev.
+ * If pnLockTimeFlags is given the sequence lock flags for that block are returned in it.
+ */
+uint32_t GetBlockScriptFlags(const CBlockIndex *pindexPrev,
+    int32_t nVersion,
+    int64_t nTime,
+    const CChainParams &chainparams,
+    int *pnLockTimeFlags = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
@@ -488,6 +538,15 @@ public:
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageStartChars &messageStart);
 bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos, const Consensus::Params &consensusParams);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus::Params &consensusParams);
+/** Get the serialized block stored at pos without copying it out of the block file where possible.  The
+ *  span stays readable after the block file is pruned.
+ */
+bool ReadRawBlockFromDisk(CBlockFileSpan &span,
+    const CDiskBlockPos &pos,
+    const CMessageHeader::MessageStartChars &messageStart);
+bool ReadRawBlockFromDisk(CBlockFileSpan &span,
+    const CBlockIndex *pindex,
+    const CMessageHeader::MessageStartChars &messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -517,6 +576,17 @@ bool CheckBlock(const CBlock &block,
     bool fCheckPOW = true,
     bool fCheckMerkleRoot = true,
     bool conservative = false);
+/**
+ * Run the transaction checks of CheckBlock() on the transactions [nBegin, nEnd) of block, adding up their legacy
+ * sigops in nSigOps and their largest size in nLargestTx. Returns the index of the first transaction that failed
+ * CheckTransaction(), which has set state, or nEnd if they all passed.
+ */
+size_t CheckBlockTransactions(const CBlock &block,
+    size_t nBegin,
+    size_t nEnd,
+    CValidationState &state,
+    uint64_t &nSigOps,
+    uint64_t &nLargestTx);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader &block, CValidationState &state, CBlockIndex *pindexPrev);
@@ -558,6 +628,13 @@ bool InvalidateBlock(CValidationState &state, const Consensus::Params &consensus
 /** Remove invalidity status from a block and its descendants. */
 bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex);
 
+/**
+ * Replace the chain state with the UTXO set in a snapshot file (see utxosnapshot.h).  The snapshot's base
+ * block must be on the best header chain and ahead of the active chain, which then jumps to it.  Blocks up
+ * to the base that were never downloaded are marked BLOCK_ASSUMED_VALID and cannot be disconnected.
+ */
+bool ActivateUTXOSnapshot(const fs::path &path, CValidationState &state);
+
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
@@ -0,0 +1,200 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <limits>
+
+namespace
+{
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMBS = Num3072::LIMBS;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+
+//! The modulus is 2^3072 - MAX_PRIME_DIFF, the largest 3072-bit safe prime
+const limb_t MAX_PRIME_DIFF = 1103717;
+
+inline limb_t ReadLimb(const unsigned char *data)
+{
+    return LIMB_SIZE == 64 ? (limb_t)ReadLE64(data) : (limb_t)ReadLE32(data);
+}
+
+inline void WriteLimb(unsigned char *data, limb_t limb)
+{
+    if (LIMB_SIZE == 64)
+        WriteLE64(data, (uint64_t)limb);
+    else
+        WriteLE32(data, (uint32_t)limb);
+}
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLimb(data + i * sizeof(limb_t));
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+/** Whether the number is at least the modulus, which only happens for the last MAX_PRIME_DIFF values. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++)
+    {
+        if (limbs[i] != std::numeric_limits<limb_t>::max())
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus from a number that is at least the modulus is the same as adding
+    // MAX_PRIME_DIFF and dropping the carry out of the top limb
+    double_limb_t t = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++)
+    {
+        t += limbs[i];
+        limbs[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072 &a)
+{
+    // Full 6144-bit product.  No partial sum can exceed a double limb: (2^n-1)^2 + 2 * (2^n-1) = 2^2n - 1
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; i++)
+    {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++)
+        {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + product[i + j] + carry;
+            product[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        product[i + LIMBS] = carry;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime, so the upper half folds onto the lower half
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++)
+    {
+        double_limb_t t = (double_limb_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    // And so does what is left above 2^3072.  The second round can carry at most 1, the third none.
+    while (carry)
+    {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS; i++)
+        {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // The modulus is prime, so a^(p-2) is the inverse of a.  Square and multiply over the bits of p-2,
+    // which are all ones except in the lowest limb.
+    Num3072 out;
+    for (int i = LIMBS - 1; i >= 0; i--)
+    {
+        limb_t e = (i == 0) ? (limb_t)(0 - MAX_PRIME_DIFF - 2) : std::numeric_limits<limb_t>::max();
+        for (int bit = LIMB_SIZE - 1; bit >= 0; bit--)
+        {
+            out.Multiply(out);
+            if ((e >> bit) & 1)
+                out.Multiply(*this);
+        }
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072 &a) { Multiply(a.GetInverse()); }
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE])
+{
+    if (IsOverflow())
+        FullReduce();
+    for (int i = 0; i < LIMBS; i++)
+        WriteLimb(out + i * sizeof(limb_t), limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char *data, size_t len)
+{
+    // Stretch the SHA256 of the element to 3072 bits with SHA512 in counter mode
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    static_assert(Num3072::BYTE_SIZE % CSHA512::OUTPUT_SIZE == 0, "SHA512 outputs must fill a Num3072");
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; i++)
+    {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA512()
+            .Write(hash, sizeof(hash))
+            .Write(counter, sizeof(counter))
+            .Finalize(bytes + i * CSHA512::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+
+MuHash3072 &MuHash3072::Insert(const unsigned char *data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072 &MuHash3072::Remove(const unsigned char *data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072 &MuHash3072::operator*=(const MuHash3072 &mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072 &MuHash3072::operator/=(const MuHash3072 &div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+uint256 MuHash3072::Finalize()
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    numerator.ToBytes(bytes);
+    uint256 hash;
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(hash.begin());
+    return hash;
+}
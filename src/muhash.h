@@ -0,0 +1,100 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** A number modulo the 3072-bit prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+    //! Little endian limbs, always smaller than 2^3072 but not necessarily fully reduced
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! Interpret 384 little endian bytes as a number
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072 &a);
+    void Divide(const Num3072 &a);
+    //! Write the fully reduced number as 384 little endian bytes
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        for (int i = 0; i < LIMBS; i++)
+            READWRITE(limbs[i]);
+    }
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a multiset of byte strings that can be updated in constant time as elements are added and
+ * removed, and does not depend on the order of the updates.
+ *
+ * Each element is hashed to a number modulo a 3072-bit prime, and the multiset hash is the product of
+ * the numbers of all its elements (Maitland, Chen and Lemieux's MuHash).  Added elements are multiplied
+ * into a numerator and removed ones into a denominator, so that the single modular inversion is only
+ * done when the final hash is asked for.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char *data, size_t len);
+
+public:
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072 &Insert(const unsigned char *data, size_t len);
+    MuHash3072 &Remove(const unsigned char *data, size_t len);
+
+    //! Combine with the hash of another set, giving the hash of the union of both
+    MuHash3072 &operator*=(const MuHash3072 &mul);
+    //! Take out the hash of a subset
+    MuHash3072 &operator/=(const MuHash3072 &div);
+
+    //! The SHA256 of the set's number, this is the only place the inversion is done
+    uint256 Finalize();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_MUHASH_H
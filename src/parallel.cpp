@@ -16,6 +16,7 @@
 #include <vector>
 
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_set.hpp>
 
 using namespace std;
 
@@ -32,6 +33,30 @@ static void AddScriptCheckThreads(int i, CCheckQueue<CScriptCheck> *pqueue)
     pqueue->Thread();
 }
 
+static void AddPrefetchThreads(int i, CCheckQueue<CInputPrefetch> *pqueue)
+{
+    ostringstream tName;
+    tName << "bitcoin-prefetch" << i;
+    RenameThread(tName.str().c_str());
+    pqueue->Thread();
+}
+
+static void AddMerkleThreads(int i, CCheckQueue<CMerkleSubtree> *pqueue)
+{
+    ostringstream tName;
+    tName << "bitcoin-merkle" << i;
+    RenameThread(tName.str().c_str());
+    pqueue->Thread();
+}
+
+static void AddTxCheckThreads(int i, CCheckQueue<CTxRangeCheck> *pqueue)
+{
+    ostringstream tName;
+    tName << "bitcoin-txcheck" << i;
+    RenameThread(tName.str().c_str());
+    pqueue->Thread();
+}
+
 CParallelValidation::CParallelValidation(int threadCount, boost::thread_group *threadGroup)
     : semThreadCount(nScriptCheckQueues)
 {
@@ -46,19 +71,258 @@ CParallelValidation::CParallelValidation(int threadCount, boost::thread_group *t
 
     while (QueueCount() < nScriptCheckQueues)
     {
-        auto queue = new CCheckQueue<CScriptCheck>(128);
+        auto queue = new CCheckQueue<CScriptCheck>(128, nThreads);
 
         for (unsigned int i = 0; i < nThreads; i++)
             threadGroup->create_thread(boost::bind(&AddScriptCheckThreads, i + 1, queue));
 
         vQueues.push_back(queue);
     }
+
+    pPrefetchQueue = new CCheckQueue<CInputPrefetch>(128, nThreads);
+    for (unsigned int i = 0; i < nThreads; i++)
+        threadGroup->create_thread(boost::bind(&AddPrefetchThreads, i + 1, pPrefetchQueue));
+
+    // Every subtree is a sizeable job of its own, so hand them out one at a time.
+    pMerkleQueue = new CCheckQueue<CMerkleSubtree>(1, nThreads);
+    for (unsigned int i = 0; i < nThreads; i++)
+        threadGroup->create_thread(boost::bind(&AddMerkleThreads, i + 1, pMerkleQueue));
+
+    // Ranges are sized so that each thread gets a few of them, so hand them out one at a time as well.
+    pTxCheckQueue = new CCheckQueue<CTxRangeCheck>(1, nThreads);
+    for (unsigned int i = 0; i < nThreads; i++)
+        threadGroup->create_thread(boost::bind(&AddTxCheckThreads, i + 1, pTxCheckQueue));
 }
 
 CParallelValidation::~CParallelValidation()
 {
     for (auto queue : vQueues)
         delete queue;
+    delete pPrefetchQueue;
+    delete pMerkleQueue;
+    delete pTxCheckQueue;
+}
+
+void CParallelValidation::PrefetchInputs(const CBlock &block, const CCoinsViewCache *view)
+{
+    AssertLockHeld(cs_main);
+
+    // Without script check threads there is no parallelism to be had, just let ConnectBlock() read the coins.
+    if (!nThreads)
+        return;
+
+    // Outputs created within this block can not be in the database yet, so don't bother looking them up.
+    boost::unordered_set<uint256, BlockHasher> setBlockTxids;
+    for (const CTransaction &tx : block.vtx)
+        setBlockTxids.insert(tx.GetHash());
+
+    std::vector<CInputPrefetch> vPrefetch;
+    for (const CTransaction &tx : block.vtx)
+    {
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn &txin : tx.vin)
+        {
+            if (!setBlockTxids.count(txin.prevout.hash))
+                vPrefetch.push_back(CInputPrefetch(view, txin.prevout));
+        }
+    }
+    if (vPrefetch.empty())
+        return;
+
+    CCheckQueueControl<CInputPrefetch> control(pPrefetchQueue);
+    control.Add(vPrefetch);
+    control.Wait();
+}
+
+uint256 CParallelValidation::MerkleRoot(const std::vector<uint256> &leaves, bool *mutated)
+{
+    if (nThreads && leaves.size() >= MIN_PARALLEL_MERKLE_LEAVES)
+    {
+        TRY_LOCK(cs_merklequeue, lockMerkle);
+        if (lockMerkle)
+            return ComputeMerkleRootParallel(leaves, mutated, pMerkleQueue, nThreads);
+    }
+    return ComputeMerkleRoot(leaves, mutated);
+}
+
+std::vector<uint256> CParallelValidation::MerkleBranch(const std::vector<uint256> &leaves, uint32_t position)
+{
+    if (nThreads && leaves.size() >= MIN_PARALLEL_MERKLE_LEAVES)
+    {
+        TRY_LOCK(cs_merklequeue, lockMerkle);
+        if (lockMerkle)
+            return ComputeMerkleBranchParallel(leaves, position, pMerkleQueue, nThreads);
+    }
+    return ComputeMerkleBranch(leaves, position);
+}
+
+uint256 CParallelValidation::BlockMerkleRoot(const CBlock &block, bool *mutated)
+{
+    if (block.vtx.size() < MIN_PARALLEL_MERKLE_LEAVES)
+        return ::BlockMerkleRoot(block, mutated);
+
+    std::vector<uint256> leaves(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        leaves[i] = block.vtx[i].GetHash();
+    return MerkleRoot(leaves, mutated);
+}
+
+size_t CParallelValidation::CheckBlockTransactions(const CBlock &block,
+    CValidationState &state,
+    uint64_t &nSigOps,
+    uint64_t &nLargestTx)
+{
+    if (nThreads && block.vtx.size() >= MIN_PARALLEL_TXCHECK_TXS)
+    {
+        TRY_LOCK(cs_txcheckqueue, lockTxCheck);
+        if (lockTxCheck)
+            return CheckBlockTransactionsParallel(block, state, nSigOps, nLargestTx, pTxCheckQueue, nThreads);
+    }
+    return ::CheckBlockTransactions(block, 0, block.vtx.size(), state, nSigOps, nLargestTx);
+}
+
+bool CTxRangeCheck::operator()()
+{
+    result->nFailed =
+        ::CheckBlockTransactions(*block, nBegin, nEnd, result->state, result->nSigOps, result->nLargestTx);
+    return true;
+}
+
+size_t CheckBlockTransactionsParallel(const CBlock &block,
+    CValidationState &state,
+    uint64_t &nSigOps,
+    uint64_t &nLargestTx,
+    CCheckQueue<CTxRangeCheck> *pqueue,
+    unsigned int nThreads)
+{
+    // Aim for a few ranges per thread so that they all finish at about the same time
+    size_t nTx = block.vtx.size();
+    size_t nRange = std::max((size_t)512, nTx / (4 * (nThreads + 1)));
+    if (!pqueue || nRange >= nTx)
+        return CheckBlockTransactions(block, 0, nTx, state, nSigOps, nLargestTx);
+
+    size_t nRanges = (nTx + nRange - 1) / nRange;
+    std::vector<CTxRangeResult> vResults(nRanges);
+    std::vector<CTxRangeCheck> vChecks;
+    vChecks.reserve(nRanges);
+    for (size_t i = 0; i < nRanges; i++)
+        vChecks.push_back(CTxRangeCheck(&block, i * nRange, std::min(nTx, (i + 1) * nRange), &vResults[i]));
+    CCheckQueueControl<CTxRangeCheck> control(pqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    // The serial checks stop at the first bad transaction, which is in the first range that has one.
+    for (size_t i = 0; i < nRanges; i++)
+    {
+        const CTxRangeResult &result = vResults[i];
+        if (result.nFailed < std::min(nTx, (i + 1) * nRange))
+        {
+            state = result.state;
+            return result.nFailed;
+        }
+        nSigOps += result.nSigOps;
+        nLargestTx = std::max(nLargestTx, result.nLargestTx);
+    }
+    return nTx;
+}
+
+bool CMerkleSubtree::operator()()
+{
+    *root = ComputeMerkleSubtree(leaves, count, height, mutated);
+    return true;
+}
+
+/**
+ * The height of the subtrees to split a tree with nLeaves leaves into, or 0 if it is not worth splitting.
+ * Aim for a few subtrees per thread so that they all finish at about the same time, but don't make them so
+ * small that handing them out costs more than hashing them.
+ */
+static unsigned int MerkleSubtreeHeight(size_t nLeaves, unsigned int nThreads)
+{
+    size_t nTarget = std::max((size_t)1024, nLeaves / (4 * (nThreads + 1)));
+    unsigned int height = 0;
+    while ((((size_t)1) << height) < nTarget)
+        height++;
+    if ((((size_t)1) << height) >= nLeaves)
+        return 0;
+    return height;
+}
+
+/** Compute the roots of all subtrees of the given height on the threads of pqueue. */
+static void ComputeMerkleSubtrees(const std::vector<uint256> &leaves,
+    unsigned int height,
+    std::vector<uint256> &vRoots,
+    bool *mutated,
+    CCheckQueue<CMerkleSubtree> *pqueue)
+{
+    size_t nSubtreeLeaves = ((size_t)1) << height;
+    size_t nSubtrees = (leaves.size() + nSubtreeLeaves - 1) / nSubtreeLeaves;
+    vRoots.resize(nSubtrees);
+    std::unique_ptr<bool[]> vMutated(new bool[nSubtrees]());
+
+    std::vector<CMerkleSubtree> vChecks;
+    vChecks.reserve(nSubtrees);
+    for (size_t i = 0; i < nSubtrees; i++)
+    {
+        size_t nCount = std::min(nSubtreeLeaves, leaves.size() - i * nSubtreeLeaves);
+        vChecks.push_back(CMerkleSubtree(
+            &leaves[i * nSubtreeLeaves], nCount, height, &vRoots[i], mutated ? &vMutated[i] : nullptr));
+    }
+    CCheckQueueControl<CMerkleSubtree> control(pqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    if (mutated)
+    {
+        *mutated = false;
+        for (size_t i = 0; i < nSubtrees; i++)
+            *mutated |= vMutated[i];
+    }
+}
+
+uint256 ComputeMerkleRootParallel(const std::vector<uint256> &leaves,
+    bool *mutated,
+    CCheckQueue<CMerkleSubtree> *pqueue,
+    unsigned int nThreads)
+{
+    unsigned int height = MerkleSubtreeHeight(leaves.size(), nThreads);
+    if (!pqueue || height == 0)
+        return ComputeMerkleRoot(leaves, mutated);
+
+    // The subtrees are aligned to their own size, so every pair of siblings below their roots lies within
+    // one subtree and the mutation check on each subtree sees all of them.
+    std::vector<uint256> vRoots;
+    bool fSubtreeMutated = false;
+    ComputeMerkleSubtrees(leaves, height, vRoots, mutated ? &fSubtreeMutated : nullptr, pqueue);
+    uint256 root = ComputeMerkleRoot(vRoots, mutated);
+    if (mutated)
+        *mutated |= fSubtreeMutated;
+    return root;
+}
+
+std::vector<uint256> ComputeMerkleBranchParallel(const std::vector<uint256> &leaves,
+    uint32_t position,
+    CCheckQueue<CMerkleSubtree> *pqueue,
+    unsigned int nThreads)
+{
+    unsigned int height = MerkleSubtreeHeight(leaves.size(), nThreads);
+    if (!pqueue || height == 0 || position >= leaves.size())
+        return ComputeMerkleBranch(leaves, position);
+
+    std::vector<uint256> vRoots;
+    ComputeMerkleSubtrees(leaves, height, vRoots, nullptr, pqueue);
+
+    // The lower part of the branch lies within the leaf's own subtree, the upper part in the tree of roots.
+    size_t nSubtreeLeaves = ((size_t)1) << height;
+    size_t nSubtree = position / nSubtreeLeaves;
+    std::vector<uint256> branch;
+    ComputeMerkleSubtree(&leaves[nSubtree * nSubtreeLeaves],
+        std::min(nSubtreeLeaves, leaves.size() - nSubtree * nSubtreeLeaves), height, nullptr,
+        position % nSubtreeLeaves, &branch);
+    std::vector<uint256> upper = ComputeMerkleBranch(vRoots, nSubtree);
+    branch.insert(branch.end(), upper.begin(), upper.end());
+    return branch;
 }
 
 unsigned int CParallelValidation::QueueCount()
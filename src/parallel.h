@@ -6,6 +6,7 @@
 #define BITCOIN_PARALLEL_H
 
 #include "checkqueue.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "primitives/block.h"
@@ -21,25 +22,28 @@
 
 /**
  * Closure representing one script verification
- * Note that this stores references to the spending transaction
+ * Note that this stores references to the spending transaction, to its precomputed signature hash data and
+ * to the scriptPubKey of the coin being spent, all of which must outlive the check. The script is not copied
+ * so that creating and queueing a check does not allocate.
  */
 class CScriptCheck
 {
 protected:
     ValidationResourceTracker *resourceTracker;
-    CScript scriptPubKey;
+    const CScript *scriptPubKey;
     CAmount amount;
     const CTransaction *ptxTo;
     unsigned int nIn;
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData *txdata;
 
 public:
     unsigned char sighashType;
     CScriptCheck()
-        : resourceTracker(nullptr), amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false),
-          error(SCRIPT_ERR_UNKNOWN_ERROR), sighashType(0)
+        : resourceTracker(nullptr), scriptPubKey(nullptr), amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false),
+          error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), sighashType(0)
     {
     }
 
@@ -49,9 +53,11 @@ public:
         const CTransaction &txToIn,
         unsigned int nInIn,
         unsigned int nFlagsIn,
-        bool cacheIn)
-        : resourceTracker(resourceTrackerIn), scriptPubKey(scriptPubKeyIn), amount(amountIn), ptxTo(&txToIn),
-          nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), sighashType(0)
+        bool cacheIn,
+        const PrecomputedTransactionData &txdataIn)
+        : resourceTracker(resourceTrackerIn), scriptPubKey(&scriptPubKeyIn), amount(amountIn), ptxTo(&txToIn),
+          nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(&txdataIn),
+          sighashType(0)
     {
     }
 
@@ -60,19 +66,152 @@ public:
     void swap(CScriptCheck &check)
     {
         std::swap(resourceTracker, check.resourceTracker);
-        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(scriptPubKey, check.scriptPubKey);
         std::swap(ptxTo, check.ptxTo);
         std::swap(amount, check.amount);
         std::swap(nIn, check.nIn);
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
         std::swap(sighashType, check.sighashType);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure that loads one coin spent by a block into a coins cache before the block is connected.
+ * Always succeeds; a coin that can not be found is simply not loaded.
+ */
+class CInputPrefetch
+{
+protected:
+    const CCoinsViewCache *view;
+    COutPoint outpoint;
+
+public:
+    CInputPrefetch() : view(nullptr) {}
+    CInputPrefetch(const CCoinsViewCache *viewIn, const COutPoint &outpointIn) : view(viewIn), outpoint(outpointIn) {}
+    bool operator()()
+    {
+        view->PrefetchCoin(outpoint);
+        return true;
+    }
+
+    void swap(CInputPrefetch &check)
+    {
+        std::swap(view, check.view);
+        std::swap(outpoint, check.outpoint);
+    }
+};
+
+/**
+ * Closure that computes one subtree of a merkle tree, see ComputeMerkleSubtree(). The leaves and the
+ * result must outlive the closure.
+ */
+class CMerkleSubtree
+{
+protected:
+    const uint256 *leaves;
+    size_t count;
+    unsigned int height;
+    uint256 *root;
+    bool *mutated;
+
+public:
+    CMerkleSubtree() : leaves(nullptr), count(0), height(0), root(nullptr), mutated(nullptr) {}
+    CMerkleSubtree(const uint256 *leavesIn, size_t countIn, unsigned int heightIn, uint256 *rootIn, bool *mutatedIn)
+        : leaves(leavesIn), count(countIn), height(heightIn), root(rootIn), mutated(mutatedIn)
+    {
+    }
+    bool operator()();
+
+    void swap(CMerkleSubtree &check)
+    {
+        std::swap(leaves, check.leaves);
+        std::swap(count, check.count);
+        std::swap(height, check.height);
+        std::swap(root, check.root);
+        std::swap(mutated, check.mutated);
+    }
+};
+
+/** Blocks with fewer transactions than this have their merkle tree computed on a single thread. */
+static const unsigned int MIN_PARALLEL_MERKLE_LEAVES = 8192;
+
+/**
+ * Compute the merkle root of leaves, hashing the lower levels of the tree as separate subtrees on the
+ * threads of pqueue. The result, including *mutated, is exactly that of ComputeMerkleRoot(). The queue
+ * must not be used by anyone else at the same time.
+ */
+uint256 ComputeMerkleRootParallel(const std::vector<uint256> &leaves,
+    bool *mutated,
+    CCheckQueue<CMerkleSubtree> *pqueue,
+    unsigned int nThreads);
+
+/** Compute the merkle branch for leaf number position like ComputeMerkleBranch(), in parallel as above. */
+std::vector<uint256> ComputeMerkleBranchParallel(const std::vector<uint256> &leaves,
+    uint32_t position,
+    CCheckQueue<CMerkleSubtree> *pqueue,
+    unsigned int nThreads);
+
+/** The outcome of checking one range of a block's transactions, see CheckBlockTransactions(). */
+struct CTxRangeResult
+{
+    CValidationState state;
+    size_t nFailed;
+    uint64_t nSigOps;
+    uint64_t nLargestTx;
+
+    CTxRangeResult() : nFailed(0), nSigOps(0), nLargestTx(0) {}
+};
+
+/**
+ * Closure that runs the context free checks of CheckBlock() on a range of a block's transactions. The block and
+ * the result must outlive the closure. A failure is only recorded in the result, so that the other ranges still
+ * run and the caller can report the same transaction the serial checks would have.
+ */
+class CTxRangeCheck
+{
+protected:
+    const CBlock *block;
+    size_t nBegin;
+    size_t nEnd;
+    CTxRangeResult *result;
+
+public:
+    CTxRangeCheck() : block(nullptr), nBegin(0), nEnd(0), result(nullptr) {}
+    CTxRangeCheck(const CBlock *blockIn, size_t nBeginIn, size_t nEndIn, CTxRangeResult *resultIn)
+        : block(blockIn), nBegin(nBeginIn), nEnd(nEndIn), result(resultIn)
+    {
+    }
+    bool operator()();
+
+    void swap(CTxRangeCheck &check)
+    {
+        std::swap(block, check.block);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(result, check.result);
+    }
+};
+
+/** Blocks with fewer transactions than this have them checked on a single thread. */
+static const unsigned int MIN_PARALLEL_TXCHECK_TXS = 4096;
+
+/**
+ * Run CheckBlockTransactions() over all of block's transactions, split into ranges that are checked on the threads
+ * of pqueue. The result, including which failure is reported in state, is exactly that of the serial checks. The
+ * queue must not be used by anyone else at the same time.
+ */
+size_t CheckBlockTransactionsParallel(const CBlock &block,
+    CValidationState &state,
+    uint64_t &nSigOps,
+    uint64_t &nLargestTx,
+    CCheckQueue<CTxRangeCheck> *pqueue,
+    unsigned int nThreads);
+
 class CParallelValidation
 {
 private:
@@ -81,6 +220,14 @@ private:
     std::vector<uint256> vPreviousBlock;
     // Vector of script check queues
     std::vector<CCheckQueue<CScriptCheck> *> vQueues;
+    // Queue used to load the coins spent by a block from the database in parallel
+    CCheckQueue<CInputPrefetch> *pPrefetchQueue;
+    // Queue used to compute large merkle trees in parallel, only one caller at a time can use it
+    CCriticalSection cs_merklequeue;
+    CCheckQueue<CMerkleSubtree> *pMerkleQueue;
+    // Queue used to check the transactions of large blocks in parallel, only one caller at a time can use it
+    CCriticalSection cs_txcheckqueue;
+    CCheckQueue<CTxRangeCheck> *pTxCheckQueue;
     unsigned int nThreads;
     // The semaphore limits the number of parallel validation threads
     CSemaphore semThreadCount;
@@ -177,8 +324,38 @@ public:
 
     // For newly mined block validation, return the first queue not in use.
     CCheckQueue<CScriptCheck> *GetScriptCheckQueue();
+
+    /**
+     * Load the coins spent by this block into the given cache using a pool of prefetch threads, so that
+     * connecting the block does not have to wait for one database read after another. The cache's backing
+     * view must be safe to read concurrently. Requires cs_main so that the coins database can not be
+     * flushed while the coins are being read.
+     */
+    void PrefetchInputs(const CBlock &block, const CCoinsViewCache *view);
+
+    /**
+     * Compute the merkle root like ComputeMerkleRoot(), spreading the work over a pool of threads if the tree
+     * is large enough. If another thread is already using the pool the tree is computed serially instead.
+     */
+    uint256 MerkleRoot(const std::vector<uint256> &leaves, bool *mutated = nullptr);
+    //! Compute a merkle branch like ComputeMerkleBranch(), in parallel like MerkleRoot().
+    std::vector<uint256> MerkleBranch(const std::vector<uint256> &leaves, uint32_t position);
+    //! The merkle root of a block's transactions, see BlockMerkleRoot().
+    uint256 BlockMerkleRoot(const CBlock &block, bool *mutated = nullptr);
+
+    /**
+     * Run CheckBlockTransactions() over all of block's transactions, on a pool of threads if there are enough of
+     * them. If another thread is already using the pool they are checked serially instead.
+     */
+    size_t CheckBlockTransactions(const CBlock &block, CValidationState &state, uint64_t &nSigOps, uint64_t &nLargestTx);
 };
 
 extern std::unique_ptr<CParallelValidation> PV; // Singleton class
 
+// Script check queue statistics, updated after each block's script checks have completed
+extern CStatHistory<unsigned int> nScriptCheckQueueDepth;
+extern CStatHistory<uint64_t> nScriptCheckSteals;
+extern CStatHistory<uint64_t> nScriptCheckCount;
+extern CStatHistory<uint64_t> nScriptCheckAllocations;
+
 #endif // BITCOIN_PARALLEL_H
@@ -20,6 +20,7 @@
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "hash.h"
 
 #include <stdint.h>
@@ -449,6 +450,9 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    if (pblockindex->nStatus & BLOCK_ASSUMED_VALID)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (loaded from a UTXO snapshot)");
+
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -463,7 +467,8 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex, false, fListTxns);
 }
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+template <typename Stream>
+static void ApplyStats(CCoinsStats &stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
@@ -479,40 +484,69 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
     ss << VARINT(0);
 }
 
+/** What the scan of one range of the coins adds to the statistics, and to the serialization that is hashed */
+struct CRangeStats
+{
+    CCoinsStats stats;
+    CDataStream ssSerialized;
+
+    CRangeStats() : ssSerialized(SER_GETHASH, PROTOCOL_VERSION) {}
+};
+
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsViewDB *view, CCoinsStats &stats)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
+    // The ranges split the coins on txid boundaries, so all outputs of a transaction are in the same range,
+    // and the serializations of the ranges hashed one after the other are those of the whole set in order
+    std::vector<CRangeStats> vRangeStats(DEFAULT_COIN_SCAN_RANGES);
+    auto scan = [&vRangeStats](int nRange, CCoinsViewCursor &cursor) {
+        CRangeStats &range = vRangeStats[nRange];
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (cursor.Valid()) {
+            COutPoint key;
+            Coin coin;
+            if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+                if (!outputs.empty() && key.hash != prevkey) {
+                    ApplyStats(range.stats, range.ssSerialized, prevkey, outputs);
+                    outputs.clear();
+                }
+                prevkey = key.hash;
+                outputs[key.n] = std::move(coin);
+            } else {
+                return error("%s: unable to read value", __func__);
+            }
+            cursor.Next();
+        }
+        if (!outputs.empty()) {
+            ApplyStats(range.stats, range.ssSerialized, prevkey, outputs);
+        }
+        return true;
+    };
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
+    bool fHeaderWritten = false;
+    auto merge = [&](int nRange) {
+        // The best block leads the serialization, it is only known once the scan has started
+        if (!fHeaderWritten) {
+            ss << stats.hashBlock;
+            fHeaderWritten = true;
+        }
+        CRangeStats &range = vRangeStats[nRange];
+        ss.write(range.ssSerialized.data(), range.ssSerialized.size());
+        stats.nTransactions += range.stats.nTransactions;
+        stats.nTransactionOutputs += range.stats.nTransactionOutputs;
+        stats.nTotalAmount += range.stats.nTotalAmount;
+        range = CRangeStats();
+        return true;
+    };
+    if (!view->ScanCoinRanges(vRangeStats.size(), GetNumCores(), scan, merge, stats.hashBlock))
+        return false;
+
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
     stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
     return true;
@@ -521,28 +555,61 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "With the default hash_type they are kept up to date as blocks are connected, and returned at once.\n"
+            "hash_serialized_2 goes through the whole set instead, on all cores, so note this may take some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"     (string, optional, default=muhash) Which UTXO set hash to calculate,\n"
+            "                     muhash or hash_serialized_2\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, hash_serialized_2 only\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bogosize\": n,          (numeric) A database-independent metric for UTXO set size, muhash only\n"
+            "  \"muhash\": \"hash\",       (string) The rolling multiset hash of the set, muhash only\n"
+            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash, hash_serialized_2 only\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"hash_serialized_2\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "muhash";
+    if (strHashType != "muhash" && strHashType != "hash_serialized_2")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash")
+    {
+        CUTXOCommitment commitment;
+        int nHeight;
+        uint256 hashBlock;
+        {
+            LOCK(cs_main);
+            if (!pcoinsTip->GetCommitment(commitment))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "The UTXO set commitment is not known, use hash_serialized_2");
+            hashBlock = pcoinsTip->GetBestBlock();
+            nHeight = mapBlockIndex.find(hashBlock)->second->nHeight;
+        }
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+        ret.push_back(Pair("txouts", (int64_t)commitment.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)commitment.nBogoSize));
+        ret.push_back(Pair("muhash", commitment.muhash.Finalize().GetHex()));
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsdbview->EstimateSize()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview,stats)) {
@@ -557,6 +624,105 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+//! Resolve a snapshot path given to an RPC, relative paths are taken to be in the data directory
+static fs::path SnapshotPath(const UniValue& param)
+{
+    fs::path path(param.get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    return path;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set to a snapshot file, which another node can be\n"
+            "brought up from with loadtxoutset or -loadutxosnapshot.\n"
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) The file to write, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,      (numeric) The number of coins in the snapshot\n"
+            "  \"base_hash\": \"hash\",     (string) The block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "  \"path\": \"path\",          (string) The absolute path of the snapshot\n"
+            "  \"checksum\": \"hash\"       (string) The checksum stored at the end of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = SnapshotPath(params[0]);
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    // The database cursor is a consistent view, so only getting it needs cs_main
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+    }
+    CUTXOSnapshotHeader header;
+    uint64_t nCoins = 0;
+    uint256 hashFile;
+    if (!DumpUTXOSnapshot(pcursor.get(), path, header, nCoins, hashFile))
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to write the snapshot, see debug.log for details");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", (uint64_t)nCoins));
+    ret.push_back(Pair("base_hash", header.hashBaseBlock.GetHex()));
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("base_height", mapBlockIndex[header.hashBaseBlock]->nHeight));
+    }
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("checksum", hashFile.GetHex()));
+    return ret;
+}
+
+UniValue loadtxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nReplace the unspent transaction output set with the one in a snapshot written by dumptxoutset,\n"
+            "and continue the chain from the block it was taken at.  The block headers up to that block must\n"
+            "have been received already, and the active chain must not be past it.\n"
+            "Blocks before it are not downloaded or validated, so only load snapshots from a node you trust.\n"
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) The snapshot file, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",     (string) The block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "  \"height\": n              (numeric) The height of the active chain after loading\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = SnapshotPath(params[0]);
+    CUTXOSnapshotHeader header;
+    if (!ReadUTXOSnapshotHeader(path, header))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot read a UTXO snapshot from " + path.string());
+
+    CValidationState state;
+    if (!ActivateUTXOSnapshot(path, state))
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to load the snapshot: " + state.GetRejectReason());
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", header.hashBaseBlock.GetHex()));
+    ret.push_back(Pair("base_height", mapBlockIndex[header.hashBaseBlock]->nHeight));
+    ret.push_back(Pair("height", chainActive.Height()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -637,6 +803,70 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue DBStatsToJSON(CDBWrapper &db)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("ibd_mode", db.IsIBDMode()));
+    std::string strMemory;
+    if (db.GetProperty("leveldb.approximate-memory-usage", strMemory))
+        ret.push_back(Pair("memory_usage", (uint64_t)atoi64(strMemory)));
+    double dCompactionTime = 0;
+    UniValue levels(UniValue::VARR);
+    for (const CDBLevelStats &stats : db.GetLevelStats())
+    {
+        UniValue level(UniValue::VOBJ);
+        level.push_back(Pair("level", stats.nLevel));
+        level.push_back(Pair("files", stats.nFiles));
+        level.push_back(Pair("size_mb", stats.dSizeMB));
+        level.push_back(Pair("compaction_time", stats.dCompactionTime));
+        level.push_back(Pair("compaction_read_mb", stats.dCompactionReadMB));
+        level.push_back(Pair("compaction_write_mb", stats.dCompactionWriteMB));
+        levels.push_back(level);
+        dCompactionTime += stats.dCompactionTime;
+    }
+    ret.push_back(Pair("compaction_time", dCompactionTime));
+    ret.push_back(Pair("levels", levels));
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns what LevelDB reports about the chain state and block index databases.\n"
+            "Compaction figures are since the node was started.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {             (json object) The chain state database\n"
+            "    \"ibd_mode\": true|false,   (boolean) Whether it is written in initial block download mode\n"
+            "    \"memory_usage\": n,        (numeric) The approximate memory used by its memtables and table cache\n"
+            "    \"compaction_time\": x.xxx, (numeric) The seconds spent compacting it\n"
+            "    \"levels\": [               (array) The levels that have files or were compacted\n"
+            "      {\n"
+            "        \"level\": n,                  (numeric) The level\n"
+            "        \"files\": n,                  (numeric) The number of table files in it\n"
+            "        \"size_mb\": x.xxx,            (numeric) The size of these files in MB\n"
+            "        \"compaction_time\": x.xxx,    (numeric) The seconds spent compacting into it\n"
+            "        \"compaction_read_mb\": x.xxx, (numeric) The MB read by these compactions\n"
+            "        \"compaction_write_mb\": x.xxx (numeric) The MB written by them\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  },\n"
+            "  \"blockindex\": { ... }       (json object) The block index database, as above\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDB())));
+    ret.push_back(Pair("blockindex", DBStatsToJSON(*pblocktree)));
+    return ret;
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1035,12 +1265,15 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true  },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           false },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        true  },
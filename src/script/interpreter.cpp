@@ -1165,8 +1165,15 @@ uint256 GetOutputsHash(const CTransaction &txTo) {
 
 } // anon namespace
 
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction &txTo)
+{
+    hashPrevouts = GetPrevoutHash(txTo);
+    hashSequence = GetSequenceHash(txTo);
+    hashOutputs = GetOutputsHash(txTo);
+}
+
 uint256 SignatureHashBitcoinCash(const CScript &scriptCode, const CTransaction &txTo, unsigned int nIn, uint32_t nHashType,
-    const CAmount &amount, size_t *nHashedOut)
+    const CAmount &amount, size_t *nHashedOut, const PrecomputedTransactionData *cache)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
 
@@ -1178,18 +1185,18 @@ uint256 SignatureHashBitcoinCash(const CScript &scriptCode, const CTransaction &
 
         if (!(nHashType & SIGHASH_ANYONECANPAY))
         {
-            hashPrevouts = GetPrevoutHash(txTo);
+            hashPrevouts = cache ? cache->hashPrevouts : GetPrevoutHash(txTo);
         }
 
         if (!(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE &&
             (nHashType & 0x1f) != SIGHASH_NONE)
         {
-            hashSequence = GetSequenceHash(txTo);
+            hashSequence = cache ? cache->hashSequence : GetSequenceHash(txTo);
         }
 
         if ((nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE)
         {
-            hashOutputs = GetOutputsHash(txTo);
+            hashOutputs = cache ? cache->hashOutputs : GetOutputsHash(txTo);
         }
         else if ((nHashType & 0x1f) == SIGHASH_SINGLE && nIn < txTo.vout.size())
         {
@@ -1250,11 +1257,11 @@ uint256 SignatureHashLegacy(const CScript& scriptCode, const CTransaction& txTo,
     return ss.GetHash();
 }
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut)
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut, const PrecomputedTransactionData* cache)
 {
     if (nHashType & SIGHASH_FORKID)
     {
-        return SignatureHashBitcoinCash(scriptCode, txTo, nIn, nHashType, amount, nHashedOut);
+        return SignatureHashBitcoinCash(scriptCode, txTo, nIn, nHashType, amount, nHashedOut, cache);
     }
     return SignatureHashLegacy(scriptCode, txTo, nIn, nHashType, amount, nHashedOut);
 }
@@ -1284,7 +1291,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     if (nFlags & SCRIPT_ENABLE_SIGHASH_FORKID)
     {
         if (nHashType & SIGHASH_FORKID)
-            sighash = SignatureHashBitcoinCash(scriptCode, *txTo, nIn, nHashType, amount, &nHashed);
+            sighash = SignatureHashBitcoinCash(scriptCode, *txTo, nIn, nHashType, amount, &nHashed, txdata);
         else return false;
     }
     else
@@ -101,12 +101,26 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
+/**
+ * The SIGHASH_FORKID signature hash commits to the hash of all prevouts, all sequence numbers and all outputs.
+ * These are the same for every input of a transaction so they can be computed once and shared by all input
+ * checks, which makes the hashing cost of verifying a transaction linear in the number of inputs.
+ */
+struct PrecomputedTransactionData
+{
+    uint256 hashPrevouts;
+    uint256 hashSequence;
+    uint256 hashOutputs;
+
+    PrecomputedTransactionData(const CTransaction &tx);
+};
+
 // If you are signing you may call this function and the BitcoinCash or Legacy method will be chosen based on nHashType
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut=NULL);
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut=NULL, const PrecomputedTransactionData* cache=NULL);
 // If you are validating signatures, you must call the appropriate function based on what fork you are on, because
 // the nHashType SIGHASH_FORKID bit is undefined in Legacy mode -- that is, it is valid to set it to one but still
 // sign using the legacy method
-uint256 SignatureHashBitcoinCash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut=NULL);
+uint256 SignatureHashBitcoinCash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut=NULL, const PrecomputedTransactionData* cache=NULL);
 uint256 SignatureHashLegacy(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, uint32_t nHashType, const CAmount &amount, size_t* nHashedOut);
 
 class BaseSignatureChecker
@@ -139,15 +153,18 @@ private:
     mutable size_t nBytesHashed;
     mutable size_t nSigops;
     unsigned int nFlags;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
 #ifdef BITCOIN_CASH
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, unsigned int flags=SCRIPT_ENABLE_SIGHASH_FORKID) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, unsigned int flags=SCRIPT_ENABLE_SIGHASH_FORKID) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags), txdata(NULL) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, const PrecomputedTransactionData& txdataIn, unsigned int flags=SCRIPT_ENABLE_SIGHASH_FORKID) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags), txdata(&txdataIn) {}
 #else
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, unsigned int flags=0) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, unsigned int flags=0) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags), txdata(NULL) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount &amountIn, const PrecomputedTransactionData& txdataIn, unsigned int flags=0) : txTo(txToIn), nIn(nInIn), amount(amountIn), nBytesHashed(0), nSigops(0), nFlags(flags), txdata(&txdataIn) {}
 #endif
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
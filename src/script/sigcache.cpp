@@ -6,29 +6,20 @@
 
 #include "sigcache.h"
 
-#include "memusage.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
+#include "stat.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
+extern CStatHistory<uint64_t> nSigCacheHits;
+extern CStatHistory<uint64_t> nSigCacheMisses;
+extern CStatHistory<uint64_t> nSigCacheInserts;
+extern CStatHistory<uint64_t> nSigCacheEvictions;
 
 namespace {
 
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- */
-class CSignatureCacheHasher
-{
-public:
-    size_t operator()(const uint256& key) const {
-        return key.GetCheapHash();
-    }
-};
-
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -39,13 +30,10 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
-
+    CCuckooCache setValid;
 
 public:
-    CSignatureCache()
+    CSignatureCache(size_t nBytes) : setValid(nBytes)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -57,50 +45,53 @@ public:
     }
 
     bool
-    Get(const uint256& entry)
+    Get(const uint256& entry, bool fErase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        return setValid.Contains(entry, fErase);
     }
 
-    void Erase(const uint256& entry)
+    void Set(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        setValid.Insert(entry);
     }
 
-    void Set(const uint256& entry)
+    CCuckooCache::Stats GetStats()
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
-            }
-        }
-
-        setValid.insert(entry);
+        return setValid.GetStats();
     }
 };
 
+CSignatureCache &GetSignatureCache()
+{
+    static CSignatureCache signatureCache(GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20));
+    return signatureCache;
+}
+
+}
+
+void UpdateSignatureCacheStats()
+{
+    static CCriticalSection cs_sigcachestats;
+    static CCuckooCache::Stats last = {0, 0, 0, 0};
+
+    LOCK(cs_sigcachestats);
+    CCuckooCache::Stats now = GetSignatureCache().GetStats();
+    nSigCacheHits << now.nHits - last.nHits;
+    nSigCacheMisses << now.nMisses - last.nMisses;
+    nSigCacheInserts << now.nInserts - last.nInserts;
+    nSigCacheEvictions << now.nEvictions - last.nEvictions;
+    last = now;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache &signatureCache = GetSignatureCache();
 
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(entry)) {
-        if (!store) {
-            signatureCache.Erase(entry);
-        }
+    // When checking a block the entry won't be needed again, so let its slot be reused.
+    if (signatureCache.Get(entry, !store)) {
         return true;
     }
 
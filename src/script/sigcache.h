@@ -11,8 +11,7 @@
 
 #include <vector>
 
-// DoS prevention: limit cache size to less than 40MB (over 500000
-// entries on 64-bit systems).
+// DoS prevention: limit cache size to 40MB (over 1300000 entries).
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 40;
 
 class CPubKey;
@@ -24,8 +23,12 @@ private:
 
 public:
     CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, unsigned int flags, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn, amount, flags), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, const PrecomputedTransactionData& txdataIn, unsigned int flags, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn, amount, txdataIn, flags), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Add the signature cache hits, misses, inserts and evictions since the last call to the sigcache/ statistics. */
+void UpdateSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -321,6 +321,55 @@ public:
 };
 
 
+/** Deserialize straight out of memory owned by someone else, without copying it first.
+ *
+ * The memory must stay valid for as long as the reader is used.
+ */
+class CSpanReader
+{
+private:
+    const int nType;
+    const int nVersion;
+
+    const char *pbegin;
+    const char *pend;
+
+public:
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char *pbeginIn, size_t nSize)
+        : nType(nTypeIn), nVersion(nVersionIn), pbegin((const char *)pbeginIn), pend((const char *)pbeginIn + nSize)
+    {
+    }
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+    //! Bytes not read yet
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+    void read(char *pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read: end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore: end of data");
+        pbegin += nSize;
+    }
+
+    template <typename T>
+    CSpanReader &operator>>(T &obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
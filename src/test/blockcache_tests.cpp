@@ -0,0 +1,94 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "chainparams.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce, size_t nTxs)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nNonce = nNonce;
+    for (size_t i = 0; i < nTxs; i++)
+    {
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i;
+        tx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(100, 1);
+        pblock->vtx.push_back(tx);
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    std::shared_ptr<const CBlock> pblock1 = MakeBlock(1, 100), pblock2 = MakeBlock(2, 100), pblock3 = MakeBlock(3, 100);
+    CBlockCache sizer(1 << 30);
+    sizer.PutDecoded(pblock1);
+    size_t nBlockUsage = sizer.DynamicMemoryUsage();
+    BOOST_CHECK(nBlockUsage > 100 * 100);
+
+    // Room for two of the blocks
+    CBlockCache cache(nBlockUsage * 5 / 2);
+    BOOST_CHECK(!cache.GetDecoded(pblock1->GetHash()));
+    cache.PutDecoded(pblock1);
+    cache.PutDecoded(pblock2);
+    BOOST_CHECK(cache.GetDecoded(pblock1->GetHash()) == pblock1);
+    cache.PutDecoded(pblock3);
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nBlockUsage * 5 / 2);
+    // Block 2 was used least recently
+    BOOST_CHECK(cache.GetDecoded(pblock1->GetHash()) == pblock1);
+    BOOST_CHECK(!cache.GetDecoded(pblock2->GetHash()));
+    BOOST_CHECK(cache.GetDecoded(pblock3->GetHash()) == pblock3);
+
+    // The forms of a block are kept apart
+    std::vector<unsigned char> vData(1000, 7);
+    std::shared_ptr<std::vector<unsigned char> > pdata = std::make_shared<std::vector<unsigned char> >(vData);
+    CBlockFileSpan span(pdata, pdata->data(), pdata->size()), spanRead;
+    BOOST_CHECK(!cache.GetSerialized(pblock1->GetHash(), spanRead));
+    cache.PutSerialized(pblock1->GetHash(), span);
+    BOOST_CHECK(cache.GetSerialized(pblock1->GetHash(), spanRead));
+    BOOST_CHECK(std::vector<unsigned char>(spanRead.begin(), spanRead.end()) == vData);
+    BOOST_CHECK(cache.GetDecoded(pblock1->GetHash()) == pblock1);
+
+    // Too large to be kept at all
+    cache.PutDecoded(MakeBlock(4, 300));
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockcache_served_blocks, TestChain100Setup)
+{
+    const CChainParams &chainparams = Params();
+    LOCK(cs_main);
+    FlushStateToDisk();
+    CBlockIndex *pindex = chainActive.Tip();
+
+    std::shared_ptr<const CBlock> pblock = ReadServedBlock(pindex, chainparams.GetConsensus());
+    BOOST_REQUIRE(pblock);
+    BOOST_CHECK(pblock->GetHash() == pindex->GetBlockHash());
+    // Asking again gets the very same block
+    BOOST_CHECK(ReadServedBlock(pindex, chainparams.GetConsensus()) == pblock);
+
+    CBlockFileSpan span, spanAgain;
+    BOOST_CHECK(ReadServedRawBlock(span, pindex, chainparams.MessageStart()));
+    BOOST_CHECK(ReadServedRawBlock(spanAgain, pindex, chainparams.MessageStart()));
+    BOOST_CHECK(span.data() == spanAgain.data());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *pblock;
+    BOOST_CHECK(std::vector<unsigned char>(span.begin(), span.end()) == std::vector<unsigned char>(ss.begin(), ss.end()));
+    GetBlockCache().Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
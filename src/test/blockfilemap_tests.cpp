@@ -0,0 +1,85 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "main.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilemap_tests)
+
+BOOST_AUTO_TEST_CASE(spanreader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)7 << std::string("abc") << (uint8_t)1;
+    std::vector<unsigned char> vData(ss.begin(), ss.end());
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, vData.data(), vData.size());
+    uint32_t n = 0;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 7U);
+    BOOST_CHECK_EQUAL(str, "abc");
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+    uint16_t nTooLong;
+    BOOST_CHECK_THROW(reader >> nTooLong, std::ios_base::failure);
+    reader.ignore(1);
+    BOOST_CHECK(reader.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(raw_block_reads, TestChain100Setup)
+{
+    const CChainParams &chainparams = Params();
+    std::vector<CBlockFileSpan> vSpans;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        for (CBlockIndex *pindex = chainActive.Tip(); pindex; pindex = pindex->pprev)
+        {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+            CBlockFileSpan span;
+            BOOST_REQUIRE(ReadRawBlockFromDisk(span, pindex->GetBlockPos(), chainparams.MessageStart()));
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << block;
+            BOOST_CHECK(std::vector<unsigned char>(span.begin(), span.end()) ==
+                        std::vector<unsigned char>(ss.begin(), ss.end()));
+            vSpans.push_back(span);
+        }
+        BOOST_CHECK_EQUAL(vSpans.size(), (size_t)chainActive.Height() + 1);
+    }
+
+    // There is no block in the middle of one, nor before the first
+    CDiskBlockPos pos = chainActive.Tip()->GetBlockPos();
+    CBlockFileSpan span;
+    BOOST_CHECK(!ReadRawBlockFromDisk(span, CDiskBlockPos(pos.nFile, pos.nPos + 1), chainparams.MessageStart()));
+    BOOST_CHECK(!ReadRawBlockFromDisk(span, CDiskBlockPos(pos.nFile, 2), chainparams.MessageStart()));
+    BOOST_CHECK(span.empty());
+
+    // Read by index entry, the stored header has to be that of the entry
+    BOOST_CHECK(ReadRawBlockFromDisk(span, chainActive.Tip(), chainparams.MessageStart()));
+    BOOST_CHECK(std::vector<unsigned char>(span.begin(), span.end()) ==
+                std::vector<unsigned char>(vSpans[0].begin(), vSpans[0].end()));
+    CBlockIndex indexWrong(*chainActive.Tip());
+    indexWrong.nDataPos = chainActive.Tip()->pprev->nDataPos;
+    BOOST_CHECK(!ReadRawBlockFromDisk(span, &indexWrong, chainparams.MessageStart()));
+    BOOST_CHECK(span.empty());
+
+    // Blocks already read survive the removal of their file, as when it is pruned
+    std::vector<unsigned char> vTip(vSpans[0].begin(), vSpans[0].end());
+    std::set<int> setFilesToPrune;
+    setFilesToPrune.insert(pos.nFile);
+    UnlinkPrunedFiles(setFilesToPrune);
+    BOOST_CHECK(!ReadRawBlockFromDisk(span, pos, chainparams.MessageStart()));
+    BOOST_CHECK(std::vector<unsigned char>(vSpans[0].begin(), vSpans[0].end()) == vTip);
+    CBlock block;
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, vSpans[0].data(), vSpans[0].size());
+    reader >> block;
+    BOOST_CHECK(block.GetHash() == chainActive.Tip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
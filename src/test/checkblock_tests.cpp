@@ -6,15 +6,19 @@
 #include "clientversion.h"
 #include "consensus/validation.h"
 #include "main.h" // For CheckBlock
+#include "parallel.h"
 #include "primitives/block.h"
+#include "random.h"
 #include "test/test_bitcoin.h"
 #include "utiltime.h"
 
 #include <cstdio>
 
+#include <boost/bind.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 bool read_block(const std::string &filename, CBlock &block)
 {
@@ -65,4 +69,88 @@ BOOST_AUTO_TEST_CASE(TestBlock)
     }
 }
 
+static CBlock RandomBlock(int ntx)
+{
+    CBlock block;
+    block.vtx.resize(ntx);
+    for (int i = 0; i < ntx; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + insecure_rand() % 3);
+        for (CTxIn &txin : tx.vin)
+            txin.prevout = COutPoint(GetRandHash(), insecure_rand() % 4);
+        tx.vout.resize(1 + insecure_rand() % 3);
+        for (CTxOut &txout : tx.vout)
+        {
+            txout.nValue = insecure_rand() % COIN;
+            // Vary the sigops and the size of the transactions
+            for (unsigned int j = insecure_rand() % 4; j > 0; j--)
+                txout.scriptPubKey << OP_CHECKSIG;
+            txout.scriptPubKey << std::vector<unsigned char>(insecure_rand() % 100);
+        }
+        block.vtx[i] = tx;
+    }
+    return block;
+}
+
+static void CheckSameResults(const CBlock &block, CCheckQueue<CTxRangeCheck> *pqueue)
+{
+    CValidationState serialState, parallelState;
+    uint64_t nSerialSigOps = 0, nParallelSigOps = 0;
+    uint64_t nSerialLargest = 0, nParallelLargest = 0;
+    size_t nSerial = CheckBlockTransactions(block, 0, block.vtx.size(), serialState, nSerialSigOps, nSerialLargest);
+    size_t nParallel =
+        CheckBlockTransactionsParallel(block, parallelState, nParallelSigOps, nParallelLargest, pqueue, 4);
+    BOOST_CHECK_EQUAL(nSerial, nParallel);
+    BOOST_CHECK_EQUAL(serialState.IsValid(), parallelState.IsValid());
+    BOOST_CHECK_EQUAL(serialState.GetRejectReason(), parallelState.GetRejectReason());
+    if (nSerial == block.vtx.size())
+    {
+        BOOST_CHECK_EQUAL(nSerialSigOps, nParallelSigOps);
+        BOOST_CHECK_EQUAL(nSerialLargest, nParallelLargest);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_transaction_checks)
+{
+    CCheckQueue<CTxRangeCheck> queue(1, 4);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CTxRangeCheck>::Thread, &queue));
+
+    for (int ntx : {1, 511, 512, 513, 3000, 10000 + (int)(insecure_rand() % 10000)})
+    {
+        CBlock block = RandomBlock(ntx);
+        CheckSameResults(block, &queue);
+
+        // A single bad transaction anywhere, at the edges of a range or not
+        for (int loop = 0; loop < 8; loop++)
+        {
+            int nBad = loop == 0 ? 0 : loop == 1 ? ntx - 1 : loop == 2 ? std::min(ntx - 1, 512) : insecure_rand() % ntx;
+            CBlock bad(block);
+            CMutableTransaction tx(bad.vtx[nBad]);
+            tx.vin.push_back(tx.vin[0]);
+            bad.vtx[nBad] = tx;
+            CheckSameResults(bad, &queue);
+        }
+
+        // Several bad transactions in different ranges, the first one has to be reported
+        CBlock bad(block);
+        for (int loop = 0; loop < 4; loop++)
+        {
+            int nBad = insecure_rand() % ntx;
+            CMutableTransaction tx(bad.vtx[nBad]);
+            if (loop % 2)
+                tx.vout[0].nValue = -1;
+            else
+                tx.vin.clear();
+            bad.vtx[nBad] = tx;
+        }
+        CheckSameResults(bad, &queue);
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+static std::atomic<unsigned int> nChecksRun(0);
+
+// A check that counts how often it was executed and succeeds unless told otherwise
+struct CCountingCheck
+{
+    bool fOk;
+    CCountingCheck(bool fOkIn = true) : fOk(fOkIn) {}
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+    void swap(CCountingCheck &check) { std::swap(fOk, check.fOk); }
+};
+
+static void AddChecks(CCheckQueueControl<CCountingCheck> &control, unsigned int nChecks, int nFailAt = -1)
+{
+    unsigned int nAdded = 0;
+    while (nAdded < nChecks)
+    {
+        unsigned int nBatch = std::min(nChecks - nAdded, 1 + insecure_rand() % 300);
+        std::vector<CCountingCheck> vChecks;
+        for (unsigned int i = 0; i < nBatch; i++)
+            vChecks.push_back(CCountingCheck((int)(nAdded + i) != nFailAt));
+        control.Add(vChecks);
+        nAdded += nBatch;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_ok)
+{
+    CCheckQueue<CCountingCheck> queue(128, 4);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CCountingCheck>::Thread, &queue));
+
+    for (unsigned int nChecks : {0, 1, 7, 1000, 25000})
+    {
+        nChecksRun = 0;
+        BOOST_CHECK(queue.IsIdle());
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            AddChecks(control, nChecks);
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecksRun.load(), nChecks);
+        BOOST_CHECK_EQUAL(queue.QueueDepth(), 0U);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CCountingCheck> queue(128, 4);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CCountingCheck>::Thread, &queue));
+
+    for (int nFailAt : {0, 500, 9999})
+    {
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            AddChecks(control, 10000, nFailAt);
+            BOOST_CHECK(!control.Wait());
+        }
+        BOOST_CHECK(queue.IsIdle());
+
+        // The failure must not leak into the next round of checks
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            AddChecks(control, 1000);
+            BOOST_CHECK(control.Wait());
+        }
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // Without any worker threads the master must process every check by itself when it joins
+    CCheckQueue<CCountingCheck> queue(16, 2);
+    nChecksRun = 0;
+    {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        AddChecks(control, 5000);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(nChecksRun.load(), 5000U);
+    // every check sitting in a worker deque had to be stolen by the master
+    BOOST_CHECK(queue.GetLastSteals() > 0);
+    BOOST_CHECK(queue.GetLastMaxDepth() > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -63,7 +63,10 @@ public:
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage)
+    bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
         {
@@ -452,7 +455,7 @@ void WriteCoinsViewEntry(CCoinsView &view, CAmount value, char flags)
     uint256 hash;
     hash.SetNull();
     size_t cacheusage = 0;
-    view.BatchWrite(map, hash, cacheusage);
+    view.BatchWrite(map, hash, nullptr, cacheusage);
 }
 
 class SingleEntryCacheTest
@@ -524,6 +527,43 @@ BOOST_AUTO_TEST_CASE(ccoins_access)
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
 }
 
+void CheckPrefetchCoin(CAmount base_value,
+    CAmount cache_value,
+    CAmount expected_value,
+    char cache_flags,
+    char expected_flags)
+{
+    SingleEntryCacheTest test(base_value, cache_value, cache_flags);
+    test.cache.PrefetchCoin(OUTPOINT);
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    /* Check that PrefetchCoin leaves the cache in the same state as AccessCoin
+     * would, and never replaces an entry that is already cached.
+     *
+     *                 Base    Cache   Result  Cache        Result
+     *                 Value   Value   Value   Flags        Flags
+     */
+    CheckPrefetchCoin(ABSENT, ABSENT, ABSENT, NO_ENTRY, NO_ENTRY);
+    CheckPrefetchCoin(ABSENT, PRUNED, PRUNED, DIRTY, DIRTY);
+    CheckPrefetchCoin(ABSENT, VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
+    CheckPrefetchCoin(PRUNED, ABSENT, PRUNED, NO_ENTRY, FRESH);
+    CheckPrefetchCoin(PRUNED, VALUE2, VALUE2, FRESH, FRESH);
+    CheckPrefetchCoin(VALUE1, ABSENT, VALUE1, NO_ENTRY, 0);
+    CheckPrefetchCoin(VALUE1, PRUNED, PRUNED, 0, 0);
+    CheckPrefetchCoin(VALUE1, PRUNED, PRUNED, DIRTY, DIRTY);
+    CheckPrefetchCoin(VALUE1, VALUE2, VALUE2, 0, 0);
+    CheckPrefetchCoin(VALUE1, VALUE2, VALUE2, DIRTY, DIRTY);
+}
+
 void CheckSpendCoins(CAmount base_value,
     CAmount cache_value,
     CAmount expected_value,
@@ -744,5 +784,176 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_FIXTURE_TEST_CASE(ccoins_background_flush, TestingSetup)
+{
+    // Coins flushed through a CCoinsViewBackgroundFlush must be visible right away, whether or not
+    // their write has finished, and end up in the database together with the best block.
+    CCoinsViewDB db(1 << 23, true);
+    std::map<COutPoint, Coin> expected;
+    std::vector<COutPoint> spent;
+    {
+        CCoinsViewBackgroundFlush flusher(&db);
+        CCoinsViewCache cache(&flusher);
+        for (int round = 0; round < 10; round++)
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                COutPoint outpoint(GetRandHash(), 0);
+                Coin coin(CTxOut(insecure_rand() + 1, CScript() << OP_TRUE), round, false);
+                cache.AddCoin(outpoint, Coin(coin), false);
+                expected[outpoint] = coin;
+            }
+            // Spend some coins of the previous rounds, which are now either in flight or in the database
+            for (int i = 0; i < 100 && !expected.empty(); i++)
+            {
+                std::map<COutPoint, Coin>::iterator it = expected.begin();
+                std::advance(it, insecure_rand() % expected.size());
+                cache.SpendCoin(it->first);
+                spent.push_back(it->first);
+                expected.erase(it);
+            }
+            uint256 hashBlock = GetRandHash();
+            cache.SetBestBlock(hashBlock);
+            BOOST_CHECK(cache.Flush());
+
+            BOOST_CHECK(flusher.GetBestBlock() == hashBlock);
+            CCoinsViewCache reader(&flusher);
+            for (const auto &entry : expected)
+            {
+                Coin coin;
+                BOOST_CHECK(reader.GetCoin(entry.first, coin));
+                BOOST_CHECK(coin == entry.second);
+            }
+            for (const COutPoint &outpoint : spent)
+                BOOST_CHECK(!reader.HaveCoin(outpoint));
+        }
+        BOOST_CHECK(flusher.WaitForWrite());
+        BOOST_CHECK_EQUAL(flusher.DynamicMemoryUsage(), 0);
+        BOOST_CHECK(db.GetBestBlock() == cache.GetBestBlock());
+    }
+
+    size_t nCoins = 0;
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    for (; cursor->Valid(); cursor->Next())
+    {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_CHECK(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        BOOST_CHECK(expected.count(outpoint) && expected[outpoint] == coin);
+        nCoins++;
+    }
+    BOOST_CHECK_EQUAL(nCoins, expected.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(ccoins_db_ranges, TestingSetup)
+{
+    // Range cursors must go through every coin once, in the order of a single cursor, and keep seeing
+    // the database as it was when they were created
+    CCoinsViewDB db(1 << 23, true);
+    std::vector<COutPoint> vOrdered;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 2000; i++)
+        {
+            COutPoint outpoint(GetRandHash(), insecure_rand() % 3);
+            cache.AddCoin(outpoint, Coin(CTxOut(i + 1, CScript() << OP_TRUE), i, false), true);
+        }
+        // Txids at the edges of the keyspace and of the ranges
+        for (unsigned char prefix : {0x00, 0x40, 0x7f, 0x80, 0xff})
+        {
+            uint256 hash;
+            hash.begin()[0] = prefix;
+            cache.AddCoin(COutPoint(hash, 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), true);
+        }
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    for (; cursor->Valid(); cursor->Next())
+    {
+        COutPoint outpoint;
+        BOOST_CHECK(cursor->GetKey(outpoint));
+        vOrdered.push_back(outpoint);
+    }
+    BOOST_CHECK_EQUAL(vOrdered.size(), 2005U);
+
+    for (int nRanges : {1, 2, 3, 4, 7, 256, 1000, MAX_COIN_RANGES})
+    {
+        std::vector<std::unique_ptr<CCoinsViewCursor> > vCursors = db.RangeCursors(nRanges);
+        BOOST_CHECK_EQUAL(vCursors.size(), (size_t)nRanges);
+
+        // Changes made after the cursors were created are not seen by them
+        {
+            CCoinsViewCache cache(&db);
+            cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+            cache.SetBestBlock(GetRandHash());
+            BOOST_CHECK(cache.Flush());
+        }
+
+        size_t nPos = 0;
+        for (const auto &pcursor : vCursors)
+        {
+            BOOST_CHECK(pcursor->GetBestBlock() == vCursors[0]->GetBestBlock());
+            for (; pcursor->Valid(); pcursor->Next())
+            {
+                COutPoint outpoint;
+                BOOST_CHECK(pcursor->GetKey(outpoint));
+                BOOST_REQUIRE(nPos < vOrdered.size());
+                BOOST_CHECK(outpoint == vOrdered[nPos]);
+                nPos++;
+            }
+        }
+        BOOST_CHECK_EQUAL(nPos, vOrdered.size());
+        cursor.reset(db.Cursor());
+        vOrdered.clear();
+        for (; cursor->Valid(); cursor->Next())
+        {
+            COutPoint outpoint;
+            BOOST_CHECK(cursor->GetKey(outpoint));
+            vOrdered.push_back(outpoint);
+        }
+    }
+
+    // A parallel scan merges the ranges in order however the threads get to them
+    for (int nThreads : {1, 4})
+    {
+        std::vector<std::vector<COutPoint> > vRanges(64);
+        std::vector<COutPoint> vMerged;
+        uint256 hashBlock;
+        auto scan = [&vRanges](int nRange, CCoinsViewCursor &cursor) {
+            // Make the scans finish out of order
+            MilliSleep(insecure_rand() % 3);
+            for (; cursor.Valid(); cursor.Next())
+            {
+                COutPoint outpoint;
+                if (!cursor.GetKey(outpoint))
+                    return false;
+                vRanges[nRange].push_back(outpoint);
+            }
+            return true;
+        };
+        auto merge = [&vRanges, &vMerged](int nRange) {
+            vMerged.insert(vMerged.end(), vRanges[nRange].begin(), vRanges[nRange].end());
+            return true;
+        };
+        BOOST_CHECK(db.ScanCoinRanges(vRanges.size(), nThreads, scan, merge, hashBlock));
+        BOOST_CHECK(hashBlock == db.GetBestBlock());
+        BOOST_CHECK(vMerged == vOrdered);
+
+        // A failing scan stops the others and fails the whole
+        int nMerged = 0;
+        auto failingScan = [](int nRange, CCoinsViewCursor &cursor) {
+            if (nRange == 10)
+                throw std::runtime_error("scan failure");
+            return true;
+        };
+        auto countMerge = [&nMerged](int nRange) {
+            nMerged++;
+            return true;
+        };
+        BOOST_CHECK(!db.ScanCoinRanges(vRanges.size(), nThreads, failingScan, countMerge, hashBlock));
+        BOOST_CHECK_EQUAL(nMerged, 10);
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
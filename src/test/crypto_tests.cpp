@@ -10,6 +10,7 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 #include "utilstrencodings.h"
@@ -269,6 +270,60 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors)
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Compare the batched double-SHA256 against CHash256 for every batch size that exercises
+    // a different mix of the 8-way, 4-way and single lane code paths.
+    for (int i = 0; i <= 32; i++)
+    {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; j++)
+        {
+            in[j] = insecure_rand() & 0xff;
+        }
+        for (int j = 0; j < i; j++)
+        {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+
+        // Hashing in place, as the merkle root computation does, must give the same result.
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_implementations)
+{
+    // Every optional implementation must agree with the generic one, on hardware that has it. 37 hashes
+    // go through all of the 8-way, 4-way and 2-way kernels as well as the single lane fallback.
+    const sha256_implementation::UseImplementation implementations[] = {sha256_implementation::USE_SSE4,
+        sha256_implementation::USE_AVX2, sha256_implementation::USE_SHANI, sha256_implementation::USE_ALL};
+    std::vector<unsigned char> in(64 * 37);
+    for (unsigned char &c : in)
+    {
+        c = insecure_rand() & 0xff;
+    }
+
+    SHA256AutoDetect(sha256_implementation::STANDARD);
+    std::vector<unsigned char> expectedD64(32 * 37), expected(CSHA256::OUTPUT_SIZE);
+    SHA256D64(expectedD64.data(), in.data(), 37);
+    CSHA256().Write(in.data(), in.size()).Finalize(expected.data());
+
+    for (sha256_implementation::UseImplementation use : implementations)
+    {
+        BOOST_TEST_MESSAGE("sha256 implementation: " << SHA256AutoDetect(use));
+        std::vector<unsigned char> outD64(32 * 37), out(CSHA256::OUTPUT_SIZE);
+        SHA256D64(outD64.data(), in.data(), 37);
+        CSHA256().Write(in.data(), in.size()).Finalize(out.data());
+        BOOST_CHECK(outD64 == expectedD64);
+        BOOST_CHECK(out == expected);
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors)
 {
     TestSHA512("", "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -0,0 +1,130 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+static std::vector<uint256> RandomEntries(size_t n)
+{
+    std::vector<uint256> entries(n);
+    for (uint256 &entry : entries)
+        entry = GetRandHash();
+    return entries;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_empty)
+{
+    CCuckooCache cache(0);
+    uint256 entry = GetRandHash();
+    cache.Insert(entry);
+    BOOST_CHECK(!cache.Contains(entry, false));
+    BOOST_CHECK_EQUAL(cache.GetStats().nMisses, 1);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    // Filling a table to a third of its slots must keep nearly everything.
+    CCuckooCache cache(1 << 20);
+    std::vector<uint256> entries = RandomEntries(cache.Size() / 3);
+    for (const uint256 &entry : entries)
+        cache.Insert(entry);
+
+    size_t nFound = 0;
+    for (const uint256 &entry : entries)
+        nFound += cache.Contains(entry, false);
+    BOOST_CHECK(nFound >= entries.size() * 99 / 100);
+    for (const uint256 &entry : RandomEntries(1000))
+        BOOST_CHECK(!cache.Contains(entry, false));
+
+    CCuckooCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nInserts, entries.size());
+    BOOST_CHECK_EQUAL(stats.nHits, nFound);
+    BOOST_CHECK_EQUAL(stats.nMisses, entries.size() - nFound + 1000);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    // Erased entries stay visible until their slots are needed, and inserting them again keeps them.
+    CCuckooCache cache(1 << 16);
+    std::vector<uint256> erased = RandomEntries(cache.Size() / 4);
+    for (const uint256 &entry : erased)
+        cache.Insert(entry);
+    for (const uint256 &entry : erased)
+        cache.Contains(entry, true);
+    std::vector<uint256> kept(erased.begin(), erased.begin() + erased.size() / 2);
+    for (const uint256 &entry : kept)
+        cache.Insert(entry);
+
+    // Overwrite the table several times over, erased entries make room first.
+    std::vector<uint256> fresh = RandomEntries(cache.Size() / 2);
+    for (const uint256 &entry : fresh)
+        cache.Insert(entry);
+    size_t nKept = 0, nErased = 0;
+    for (const uint256 &entry : kept)
+        nKept += cache.Contains(entry, false);
+    for (size_t i = kept.size(); i < erased.size(); i++)
+        nErased += cache.Contains(erased[i], false);
+    BOOST_CHECK(nKept > nErased);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    // Once several generations have been inserted the oldest ones are gone, the newest one is kept.
+    CCuckooCache cache(1 << 16);
+    std::vector<uint256> old = RandomEntries(cache.Size() / 4);
+    for (const uint256 &entry : old)
+        cache.Insert(entry);
+    for (int i = 0; i < 4; i++)
+        for (const uint256 &entry : RandomEntries(cache.Size() / 4))
+            cache.Insert(entry);
+    std::vector<uint256> recent = RandomEntries(cache.Size() / 10);
+    for (const uint256 &entry : recent)
+        cache.Insert(entry);
+
+    size_t nOld = 0, nRecent = 0;
+    for (const uint256 &entry : old)
+        nOld += cache.Contains(entry, false);
+    for (const uint256 &entry : recent)
+        nRecent += cache.Contains(entry, false);
+    BOOST_CHECK(nOld < old.size() / 4);
+    BOOST_CHECK(nRecent >= recent.size() * 99 / 100);
+}
+
+static void LookupEntries(CCuckooCache *cache, const std::vector<uint256> *entries, std::atomic<size_t> *nFound)
+{
+    for (const uint256 &entry : *entries)
+        if (cache->Contains(entry, false))
+            (*nFound)++;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent)
+{
+    // Lookups running alongside inserts must never report an entry that was not inserted.
+    CCuckooCache cache(1 << 18);
+    std::vector<uint256> inserted = RandomEntries(cache.Size() / 4);
+    std::vector<uint256> absent = RandomEntries(cache.Size() / 4);
+    std::atomic<size_t> nFoundInserted(0), nFoundAbsent(0);
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&LookupEntries, &cache, &inserted, &nFoundInserted));
+    threads.create_thread(boost::bind(&LookupEntries, &cache, &absent, &nFoundAbsent));
+    for (const uint256 &entry : inserted)
+        cache.Insert(entry);
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(nFoundAbsent.load(), 0);
+    size_t nFound = 0;
+    for (const uint256 &entry : inserted)
+        nFound += cache.Contains(entry, false);
+    BOOST_CHECK(nFound >= inserted.size() * 99 / 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -209,6 +209,48 @@ BOOST_AUTO_TEST_CASE(existing_data_reindex)
     BOOST_CHECK_EQUAL(res3.ToString(), in2.ToString());
 }
 
+// Test the initial block download write mode
+BOOST_AUTO_TEST_CASE(dbwrapper_ibd_mode)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    create_directories(ph);
+    {
+        // An empty database is opened in IBD mode, and marked as such once it is used in it
+        CDBWrapper dbw(ph, (1 << 20), false, false, false);
+        BOOST_CHECK(dbw.IsIBDMode());
+        dbw.SetIBDMode(true);
+        for (int i = 0; i < 1000; i++)
+        {
+            CDBBatch batch(dbw);
+            batch.Write(i, GetRandHash());
+            BOOST_CHECK(dbw.WriteBatch(batch, true));
+        }
+        BOOST_CHECK(dbw.Checkpoint());
+    }
+    {
+        // It stays in IBD mode until that is switched off, which compacts all of it out of level 0
+        CDBWrapper dbw(ph, (1 << 20), false, false, false);
+        BOOST_CHECK(dbw.IsIBDMode());
+        uint256 res;
+        BOOST_CHECK(dbw.Read(999, res));
+        dbw.SetIBDMode(false);
+        BOOST_CHECK(!dbw.IsIBDMode());
+        dbw.WaitForCompaction();
+    }
+    CDBWrapper dbw(ph, (1 << 20), false, false, false);
+    BOOST_CHECK(!dbw.IsIBDMode());
+    std::vector<CDBLevelStats> vStats = dbw.GetLevelStats();
+    int nFiles = 0;
+    for (const CDBLevelStats &stats : vStats)
+    {
+        BOOST_CHECK(stats.nLevel > 0 || stats.nFiles == 0);
+        nFiles += stats.nFiles;
+    }
+    BOOST_CHECK(nFiles > 0);
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK(dbw.Exists(i));
+}
+
 BOOST_AUTO_TEST_CASE(iterator_ordering)
 {
     fs::path ph = fs::temp_directory_path() / fs::unique_path();
@@ -0,0 +1,138 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatmap.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+namespace
+{
+struct GoodHasher
+{
+    size_t operator()(uint64_t k) const { return (size_t)(k * 0x9E3779B97F4A7C15ULL); }
+};
+
+// Puts all keys into a handful of buckets, so that every lookup has to walk long probe sequences
+struct BadHasher
+{
+    size_t operator()(uint64_t k) const { return (size_t)((k % 5) << 60); }
+};
+
+template <typename Map>
+void CheckSame(const Map &map, const std::unordered_map<uint64_t, uint64_t> &expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    size_t count = 0;
+    for (typename Map::const_iterator it = map.begin(); it != map.end(); it++)
+    {
+        auto found = expected.find(it->first);
+        BOOST_CHECK(found != expected.end() && found->second == it->second);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+    for (const auto &entry : expected)
+    {
+        auto it = map.find(entry.first);
+        BOOST_CHECK(it != map.end() && it->second == entry.second);
+    }
+}
+
+template <typename Map>
+void RandomOperations(unsigned int nKeys)
+{
+    Map map;
+    std::unordered_map<uint64_t, uint64_t> expected;
+    for (int i = 0; i < 20000; i++)
+    {
+        uint64_t key = insecure_rand() % nKeys;
+        switch (insecure_rand() % 4)
+        {
+        case 0:
+        {
+            auto ret = map.emplace(key, (uint64_t)i);
+            BOOST_CHECK_EQUAL(ret.second, expected.emplace(key, i).second);
+            BOOST_CHECK_EQUAL(ret.first->second, expected[key]);
+            break;
+        }
+        case 1:
+            map[key] = i;
+            expected[key] = i;
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.count(key), expected.count(key));
+            break;
+        }
+    }
+    CheckSame(map, expected);
+
+    // Erase while iterating, as the coins views do
+    for (typename Map::iterator it = map.begin(); it != map.end();)
+    {
+        if (it->first % 3 == 0)
+        {
+            expected.erase(it->first);
+            it = map.erase(it);
+        }
+        else
+            it++;
+    }
+    CheckSame(map, expected);
+}
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_random)
+{
+    RandomOperations<CFlatHashMap<uint64_t, uint64_t, GoodHasher> >(100);
+    RandomOperations<CFlatHashMap<uint64_t, uint64_t, GoodHasher> >(10000);
+    RandomOperations<CFlatHashMap<uint64_t, uint64_t, BadHasher> >(1000);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_stable_references)
+{
+    // Entries must not move when others are inserted or erased
+    CFlatHashMap<uint64_t, uint64_t, GoodHasher> map;
+    std::vector<std::pair<uint64_t, const uint64_t *> > refs;
+    for (uint64_t i = 0; i < 1000; i++)
+        refs.push_back(std::make_pair(i, &map.emplace(i, i).first->second));
+    for (uint64_t i = 1000; i < 100000; i++)
+        map.emplace(i, i);
+    for (uint64_t i = 1000; i < 100000; i += 2)
+        map.erase(i);
+    for (const auto &ref : refs)
+    {
+        BOOST_CHECK_EQUAL(&map.find(ref.first)->second, ref.second);
+        BOOST_CHECK_EQUAL(*ref.second, ref.first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_memory)
+{
+    // Erasing entries frees the arena chunks they were in, only the table stays
+    CFlatHashMap<uint64_t, std::vector<char>, GoodHasher> map;
+    size_t nEmpty = memusage::DynamicUsage(map);
+    for (uint64_t i = 0; i < 10000; i++)
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(i), std::forward_as_tuple(100, 'x'));
+    size_t nFull = memusage::DynamicUsage(map);
+    BOOST_CHECK(nFull >= 10000 * sizeof(std::pair<const uint64_t, std::vector<char> >));
+    for (uint64_t i = 0; i < 10000; i++)
+        map.erase(i);
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    size_t nErased = memusage::DynamicUsage(map);
+    BOOST_CHECK(nErased < nFull / 2);
+
+    map.clear();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), nEmpty);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
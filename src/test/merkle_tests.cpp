@@ -4,10 +4,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "consensus/merkle.h"
+#include "parallel.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(merkle_tests, TestingSetup)
 
@@ -154,4 +157,54 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_parallel)
+{
+    CCheckQueue<CMerkleSubtree> queue(1, 4);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CMerkleSubtree>::Thread, &queue));
+
+    // Sizes around the subtree size, and some that split into a partial subtree at the right edge.
+    for (int ntx : {1000, 1024, 1025, 2048, 3 * 1024 + 5, 4096, 17 + (int)(insecure_rand() % 20000)})
+    {
+        std::vector<uint256> leaves(ntx);
+        for (int j = 0; j < ntx; j++)
+            leaves[j] = GetRandHash();
+
+        bool serialMutated = true, parallelMutated = true;
+        uint256 serialRoot = ComputeMerkleRoot(leaves, &serialMutated);
+        BOOST_CHECK(ComputeMerkleRootParallel(leaves, &parallelMutated, &queue, 4) == serialRoot);
+        BOOST_CHECK(!serialMutated && !parallelMutated);
+
+        for (int loop = 0; loop < 16; loop++)
+        {
+            int mtx = loop == 0 ? ntx - 1 : insecure_rand() % ntx;
+            std::vector<uint256> branch = ComputeMerkleBranchParallel(leaves, mtx, &queue, 4);
+            BOOST_CHECK(branch == ComputeMerkleBranch(leaves, mtx));
+            BOOST_CHECK(ComputeMerkleRootFromBranch(leaves[mtx], branch, mtx) == serialRoot);
+        }
+
+        // Duplicating the last transactions keeps the root but has to be detected, as must a duplicated pair anywhere.
+        std::vector<uint256> duplicated(leaves);
+        int duplicate = 1 << ctz(ntx);
+        for (int j = 0; j < duplicate && duplicate < ntx; j++)
+            duplicated.push_back(leaves[ntx - duplicate + j]);
+        int pos = 2 * (insecure_rand() % (ntx / 2));
+        std::vector<uint256> paired(leaves);
+        paired[pos + 1] = paired[pos];
+        for (const std::vector<uint256> &mutatedLeaves : {duplicated, paired})
+        {
+            if (mutatedLeaves.size() == leaves.size() && mutatedLeaves == leaves)
+                continue;
+            serialRoot = ComputeMerkleRoot(mutatedLeaves, &serialMutated);
+            BOOST_CHECK(ComputeMerkleRootParallel(mutatedLeaves, &parallelMutated, &queue, 4) == serialRoot);
+            BOOST_CHECK(serialMutated && parallelMutated);
+        }
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,212 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "consensus/validation.h"
+#include "crypto/common.h"
+#include "key.h"
+#include "main.h"
+#include "muhash.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(muhash_tests, BasicTestingSetup)
+
+static MuHash3072 FromElements(const std::vector<int> &vInsert, const std::vector<int> &vRemove)
+{
+    MuHash3072 muhash;
+    for (int n : vInsert)
+        muhash.Insert((const unsigned char *)&n, sizeof(n));
+    for (int n : vRemove)
+        muhash.Remove((const unsigned char *)&n, sizeof(n));
+    return muhash;
+}
+
+BOOST_AUTO_TEST_CASE(num3072_reduction)
+{
+    // p-1 is -1 modulo p, so its square is 1
+    Num3072 minusOne;
+    minusOne.limbs[0] = std::numeric_limits<Num3072::limb_t>::max() - 1103717;
+    for (int i = 1; i < Num3072::LIMBS; i++)
+        minusOne.limbs[i] = std::numeric_limits<Num3072::limb_t>::max();
+    Num3072 square = minusOne;
+    square.Multiply(minusOne);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    square.ToBytes(bytes);
+    BOOST_CHECK_EQUAL(bytes[0], 1);
+    for (size_t i = 1; i < sizeof(bytes); i++)
+        BOOST_CHECK_EQUAL(bytes[i], 0);
+
+    // The largest values that fit in 3072 bits are p to p + 1103716, which are 0 to 1103716
+    Num3072 overflow;
+    for (int i = 0; i < Num3072::LIMBS; i++)
+        overflow.limbs[i] = std::numeric_limits<Num3072::limb_t>::max();
+    overflow.ToBytes(bytes);
+    BOOST_CHECK_EQUAL(ReadLE32(bytes), 1103716U);
+    for (size_t i = 4; i < sizeof(bytes); i++)
+        BOOST_CHECK_EQUAL(bytes[i], 0);
+
+    // Dividing undoes multiplying
+    unsigned char random[Num3072::BYTE_SIZE];
+    GetRandBytes(random, sizeof(random));
+    Num3072 a(random), b = minusOne;
+    b.Multiply(a);
+    b.Divide(a);
+    unsigned char bytesMinusOne[Num3072::BYTE_SIZE];
+    b.ToBytes(bytes);
+    minusOne.ToBytes(bytesMinusOne);
+    BOOST_CHECK(memcmp(bytes, bytesMinusOne, sizeof(bytes)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_semantics)
+{
+    uint256 hashEmpty = MuHash3072().Finalize();
+    uint256 hashAB = FromElements({1, 2}, {}).Finalize();
+
+    // Order does not matter, and removing an element undoes inserting it
+    BOOST_CHECK(FromElements({2, 1}, {}).Finalize() == hashAB);
+    BOOST_CHECK(FromElements({1, 2, 3}, {3}).Finalize() == hashAB);
+    BOOST_CHECK(FromElements({3}, {3}).Finalize() == hashEmpty);
+    BOOST_CHECK(FromElements({1}, {}).Finalize() != hashAB);
+    BOOST_CHECK(FromElements({1, 1}, {}).Finalize() != FromElements({1}, {}).Finalize());
+    // An element can be removed before it is inserted
+    BOOST_CHECK(FromElements({1, 2, 3}, {3}).Finalize() == FromElements({3, 1, 2}, {3}).Finalize());
+
+    MuHash3072 combined = FromElements({1}, {});
+    combined *= FromElements({2, 3}, {});
+    combined /= FromElements({3}, {});
+    BOOST_CHECK(combined.Finalize() == hashAB);
+
+    // The state survives serialization, including what is still to be divided out
+    MuHash3072 pending = FromElements({1, 2, 3}, {3});
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << pending;
+    MuHash3072 read;
+    ss >> read;
+    BOOST_CHECK(read.Finalize() == hashAB);
+}
+
+static CUTXOCommitment ScanCommitment(CCoinsView &view)
+{
+    CUTXOCommitment commitment;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        commitment.Add(key, coin);
+    }
+    return commitment;
+}
+
+static void CheckSameCommitment(CUTXOCommitment a, CUTXOCommitment b)
+{
+    BOOST_CHECK_EQUAL(a.nTransactionOutputs, b.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(a.nTotalAmount, b.nTotalAmount);
+    BOOST_CHECK_EQUAL(a.nBogoSize, b.nBogoSize);
+    BOOST_CHECK(a.muhash.Finalize() == b.muhash.Finalize());
+}
+
+/** The commitment kept along with the chain must be the one of the coins actually in the database */
+static void CheckTipCommitment()
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    CUTXOCommitment tip, db;
+    BOOST_REQUIRE(pcoinsTip->GetCommitment(tip));
+    BOOST_REQUIRE(pcoinsdbview->GetCommitment(db));
+    CheckSameCommitment(tip, db);
+    CheckSameCommitment(db, ScanCommitment(*pcoinsdbview));
+}
+
+BOOST_FIXTURE_TEST_CASE(utxo_commitment_chain, TestChain100Setup)
+{
+    CheckTipCommitment();
+
+    // Spend a coinbase into two outputs
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    unsigned int sighashType = SIGHASH_ALL;
+    if (chainActive.Tip()->IsforkActiveOnNextBlock(miningForkTime.value))
+        sighashType |= SIGHASH_FORKID;
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[1].nValue = 12 * CENT;
+    spend.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, sighashType, coinbaseTxns[0].vout[0].nValue, 0);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)sighashType);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    CheckTipCommitment();
+    CUTXOCommitment commitmentSpent;
+    BOOST_CHECK(pcoinsTip->GetCommitment(commitmentSpent));
+    BOOST_CHECK_EQUAL(commitmentSpent.nTransactionOutputs, 102U);
+
+    // Disconnecting takes the commitment back, and connecting again arrives at the same one
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindex = chainActive.Tip();
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), pindex));
+        BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+    }
+    CheckTipCommitment();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ReconsiderBlock(state, mapBlockIndex[block.GetHash()]));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    CheckTipCommitment();
+    CUTXOCommitment commitmentAgain;
+    BOOST_CHECK(pcoinsTip->GetCommitment(commitmentAgain));
+    CheckSameCommitment(commitmentAgain, commitmentSpent);
+}
+
+BOOST_FIXTURE_TEST_CASE(utxo_commitment_rebuild, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CUTXOCommitment commitment;
+    BOOST_CHECK(db.GetCommitment(commitment));
+    BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, 0U);
+
+    // Coins written without a commitment, as by older versions, leave it unknown until it is rebuilt
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    for (int i = 0; i < 100; i++)
+        vCoins.push_back(
+            std::make_pair(COutPoint(GetRandHash(), i), Coin(CTxOut(i + 1, CScript() << OP_TRUE), i, i % 2)));
+    std::sort(vCoins.begin(), vCoins.end(),
+        [](const std::pair<COutPoint, Coin> &a, const std::pair<COutPoint, Coin> &b) { return a.first < b.first; });
+    BOOST_CHECK(db.WriteSortedCoins(vCoins, GetRandHash(), nullptr));
+    BOOST_CHECK(!db.GetCommitment(commitment));
+    BOOST_CHECK(db.RebuildCommitment());
+    BOOST_CHECK(db.GetCommitment(commitment));
+    BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, 100U);
+    BOOST_CHECK_EQUAL(commitment.nTotalAmount, 5050);
+    CheckSameCommitment(commitment, ScanCommitment(db));
+
+    // Flushing a change without a commitment drops the stored one
+    {
+        CCoinsViewCache cache(&db);
+        cache.SpendCoin(vCoins[0].first);
+        BOOST_CHECK(!cache.GetCommitment(commitment));
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.GetCommitment(commitment));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -115,12 +115,14 @@ BOOST_AUTO_TEST_CASE(sign)
             txTo[i].vin[0].scriptSig = txTo[j].vin[0].scriptSig;
 
             const CTxOut &output = txFrom.vout[txTo[i].vin[0].prevout.n];
+            const CTransaction txToConst(txTo[i]);
+            PrecomputedTransactionData txdata(txToConst);
 #ifdef BITCOIN_CASH
-            bool sigOK = CScriptCheck(nullptr, output.scriptPubKey, output.nValue, txTo[i], 0,
-                SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_ENABLE_SIGHASH_FORKID, false)();
+            bool sigOK = CScriptCheck(nullptr, output.scriptPubKey, output.nValue, txToConst, 0,
+                SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_ENABLE_SIGHASH_FORKID, false, txdata)();
 #else
-            bool sigOK = CScriptCheck(nullptr, output.scriptPubKey, output.nValue, txTo[i], 0,
-                SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, false)();
+            bool sigOK = CScriptCheck(nullptr, output.scriptPubKey, output.nValue, txToConst, 0,
+                SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, false, txdata)();
 #endif
             if (i == j)
                 BOOST_CHECK_MESSAGE(sigOK, strprintf("VerifySignature %d %d", i, j));
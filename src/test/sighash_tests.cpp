@@ -178,6 +178,32 @@ BOOST_AUTO_TEST_CASE(sighash_test)
 #endif
 }
 
+// Goal: check that the precomputed transaction data produces the same SIGHASH_FORKID hashes
+BOOST_AUTO_TEST_CASE(sighash_forkid_precomputed)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        int nHashType = insecure_rand() | SIGHASH_FORKID;
+
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        CAmount amount = insecure_rand() % 100000000;
+
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+        {
+            uint256 sh = SignatureHashBitcoinCash(scriptCode, tx, nIn, nHashType, amount);
+            uint256 shc = SignatureHashBitcoinCash(scriptCode, tx, nIn, nHashType, amount, NULL, &txdata);
+            BOOST_CHECK(sh == shc);
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
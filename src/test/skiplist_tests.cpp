@@ -4,10 +4,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "chainparams.h"
+#include "main.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 #include "util.h"
 
+#include <map>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -120,4 +123,92 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_pool_test)
+{
+    CBlockIndexPool pool;
+    std::vector<CBlockIndex *> vIndex;
+    for (int i = 0; i < 10000; i++)
+    {
+        CBlockIndex *pindex = pool.Allocate();
+        BOOST_CHECK(pindex->phashBlock == NULL && pindex->pprev == NULL && pindex->nHeight == 0);
+        pindex->nHeight = i;
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 10000U);
+    for (int i = 0; i < 10000; i++)
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, i);
+
+    // Reserved entries are laid out one after the other
+    pool.Reserve(5000);
+    CBlockIndex *pfirst = pool.Allocate();
+    for (int i = 1; i < 5000; i++)
+        BOOST_CHECK(pool.Allocate() == pfirst + i);
+    BOOST_CHECK(pool.DynamicMemoryUsage() >= 15000 * sizeof(CBlockIndex));
+
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = 1234;
+    CBlockIndex *pindex = pool.Allocate(header);
+    BOOST_CHECK_EQUAL(pindex->nVersion, 4);
+    BOOST_CHECK_EQUAL(pindex->nTime, 1234U);
+
+    pool.Clear();
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockindex_reload_test, TestChain100Setup)
+{
+    struct Entry
+    {
+        int nHeight;
+        uint256 hashPrev;
+        uint256 hashSkip;
+        unsigned int nStatus;
+        unsigned int nTx;
+        arith_uint256 nChainWork;
+    };
+    std::map<uint256, Entry> mapBefore;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        for (const auto &item : mapBlockIndex)
+        {
+            const CBlockIndex *pindex = item.second;
+            mapBefore[item.first] = {pindex->nHeight, pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(),
+                pindex->pskip ? pindex->pskip->GetBlockHash() : uint256(), pindex->nStatus, pindex->nTx,
+                pindex->nChainWork};
+        }
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    UnloadBlockIndex();
+    BOOST_CHECK(mapBlockIndex.empty());
+    BOOST_CHECK_EQUAL(poolBlockIndex.size(), 0U);
+    BOOST_CHECK(LoadBlockIndex());
+    BOOST_CHECK(InitBlockIndex(Params()));
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), mapBefore.size());
+    BOOST_CHECK_EQUAL(poolBlockIndex.size(), mapBefore.size());
+    for (const auto &item : mapBlockIndex)
+    {
+        const CBlockIndex *pindex = item.second;
+        BOOST_REQUIRE(mapBefore.count(item.first));
+        const Entry &entry = mapBefore[item.first];
+        BOOST_CHECK(pindex->GetBlockHash() == item.first);
+        BOOST_CHECK_EQUAL(pindex->nHeight, entry.nHeight);
+        BOOST_CHECK((pindex->pprev ? pindex->pprev->GetBlockHash() : uint256()) == entry.hashPrev);
+        BOOST_CHECK((pindex->pskip ? pindex->pskip->GetBlockHash() : uint256()) == entry.hashSkip);
+        BOOST_CHECK_EQUAL(pindex->nStatus, entry.nStatus);
+        BOOST_CHECK_EQUAL(pindex->nTx, entry.nTx);
+        BOOST_CHECK(pindex->nChainWork == entry.nChainWork);
+        // Entries are created in height order, so a chain is walked forwards through memory
+        if (pindex->pprev)
+            BOOST_CHECK(pindex->pprev < pindex);
+    }
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
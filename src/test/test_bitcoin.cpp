@@ -75,7 +75,9 @@ TestingSetup::~TestingSetup()
     threadGroup.join_all();
     UnloadBlockIndex();
     delete pcoinsTip;
+    pcoinsTip = NULL;
     delete pcoinsdbview;
+    pcoinsdbview = NULL;
     delete pblocktree;
     fs::remove_all(pathTemp);
 }
@@ -26,7 +26,6 @@ struct BasicTestingSetup
  */
 struct TestingSetup : public BasicTestingSetup
 {
-    CCoinsViewDB *pcoinsdbview;
     fs::path pathTemp;
     boost::thread_group threadGroup;
 
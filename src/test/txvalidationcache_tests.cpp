@@ -89,4 +89,61 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(script_execution_cache, TestChain100Setup)
+{
+    // Once a transaction's scripts passed with some flags, CheckInputs must not hand out script
+    // checks for it with the same flags again, but still must with any other flags.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    unsigned int sighashType = SIGHASH_ALL;
+    if (chainActive.Tip()->IsforkActiveOnNextBlock(miningForkTime.value))
+        sighashType |= SIGHASH_FORKID;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, sighashType, coinbaseTxns[0].vout[0].nValue, 0);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)sighashType);
+    spend.vin[0].scriptSig << vchSig;
+    CTransaction tx(spend);
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    CValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (sighashType & SIGHASH_FORKID)
+        flags |= SCRIPT_ENABLE_SIGHASH_FORKID | SCRIPT_VERIFY_STRICTENC;
+
+    // Handing out the checks does not run them, so nothing is remembered yet
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, txdata, NULL, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, txdata, NULL, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1);
+    vChecks.clear();
+
+    // Nor is it when the caller asks for the resources used
+    ValidationResourceTracker resourceTracker;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, txdata, &resourceTracker));
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, txdata, NULL, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1);
+    vChecks.clear();
+
+    // Running them inline does
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, txdata, NULL));
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, txdata, NULL, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 0);
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false, txdata, NULL,
+        &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
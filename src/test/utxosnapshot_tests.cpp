@@ -0,0 +1,148 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "utxosnapshot.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(utxosnapshot_tests)
+
+static void DumpTip(const fs::path &path, CUTXOSnapshotHeader &header, uint64_t &nCoins, uint256 &hashFile)
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    BOOST_CHECK(DumpUTXOSnapshot(pcursor.get(), path, header, nCoins, hashFile));
+    BOOST_CHECK(header.hashBaseBlock == chainActive.Tip()->GetBlockHash());
+}
+
+static void CheckSameCoins(CCoinsView &a, CCoinsView &b)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursorA(a.Cursor());
+    std::unique_ptr<CCoinsViewCursor> pcursorB(b.Cursor());
+    BOOST_CHECK(pcursorA->GetBestBlock() == pcursorB->GetBestBlock());
+    size_t nCoins = 0;
+    for (; pcursorA->Valid(); pcursorA->Next(), pcursorB->Next())
+    {
+        COutPoint keyA, keyB;
+        Coin coinA, coinB;
+        BOOST_REQUIRE(pcursorB->Valid());
+        BOOST_CHECK(pcursorA->GetKey(keyA) && pcursorA->GetValue(coinA));
+        BOOST_CHECK(pcursorB->GetKey(keyB) && pcursorB->GetValue(coinB));
+        BOOST_CHECK(keyA == keyB);
+        BOOST_CHECK(coinA.out == coinB.out && coinA.nHeight == coinB.nHeight);
+        nCoins++;
+    }
+    BOOST_CHECK(!pcursorB->Valid());
+    BOOST_CHECK(nCoins > 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(utxosnapshot_roundtrip, TestChain100Setup)
+{
+    fs::path path = pathTemp / "utxo.dat";
+    CUTXOSnapshotHeader header;
+    uint64_t nCoins = 0;
+    uint256 hashFile;
+    DumpTip(path, header, nCoins, hashFile);
+    BOOST_CHECK_EQUAL(nCoins, (uint64_t)chainActive.Height());
+
+    CUTXOSnapshotHeader headerRead;
+    uint64_t nCoinsRead = 0;
+    uint256 hashFileRead;
+    BOOST_CHECK(ReadUTXOSnapshotHeader(path, headerRead));
+    BOOST_CHECK(headerRead.hashBaseBlock == header.hashBaseBlock);
+    BOOST_CHECK(VerifyUTXOSnapshot(path, headerRead, nCoinsRead, hashFileRead));
+    BOOST_CHECK_EQUAL(nCoinsRead, nCoins);
+    BOOST_CHECK(hashFileRead == hashFile);
+
+    // Loading replaces whatever the database held before
+    CCoinsViewDB db(1 << 20, true);
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    CUTXOCommitment commitment, commitmentTip, commitmentStored;
+    BOOST_CHECK(LoadUTXOSnapshot(path, &db, headerRead, nCoinsRead, commitment));
+    BOOST_CHECK_EQUAL(nCoinsRead, nCoins);
+    CheckSameCoins(*pcoinsdbview, db);
+
+    // The loaded coins come with the same commitment the chain arrived at
+    BOOST_CHECK(pcoinsTip->GetCommitment(commitmentTip));
+    BOOST_CHECK(db.GetCommitment(commitmentStored));
+    BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, nCoins);
+    BOOST_CHECK(commitment.muhash.Finalize() == commitmentTip.muhash.Finalize());
+    BOOST_CHECK(commitmentStored.muhash.Finalize() == commitmentTip.muhash.Finalize());
+
+    // Damage anywhere in the file is noticed
+    std::vector<char> vData(fs::file_size(path));
+    {
+        FILE *file = fsbridge::fopen(path, "rb");
+        BOOST_REQUIRE(file && fread(vData.data(), 1, vData.size(), file) == vData.size());
+        fclose(file);
+    }
+    fs::path pathDamaged = pathTemp / "damaged.dat";
+    for (size_t nPos : {(size_t)0, (size_t)10, vData.size() / 2, vData.size() - 40, vData.size() - 1})
+    {
+        std::vector<char> vDamaged(vData);
+        vDamaged[nPos] ^= 1;
+        FILE *file = fsbridge::fopen(pathDamaged, "wb");
+        BOOST_REQUIRE(file && fwrite(vDamaged.data(), 1, vDamaged.size(), file) == vDamaged.size());
+        fclose(file);
+        BOOST_CHECK(!VerifyUTXOSnapshot(pathDamaged, headerRead, nCoinsRead, hashFileRead));
+    }
+    BOOST_CHECK(!VerifyUTXOSnapshot(pathTemp / "missing.dat", headerRead, nCoinsRead, hashFileRead));
+}
+
+BOOST_FIXTURE_TEST_CASE(utxosnapshot_activate, TestChain100Setup)
+{
+    fs::path path = pathTemp / "utxo.dat";
+    CUTXOSnapshotHeader header;
+    uint64_t nCoins = 0;
+    uint256 hashFile;
+    DumpTip(path, header, nCoins, hashFile);
+    CBlockIndex *pindexBase = chainActive.Tip();
+
+    // The chain cannot jump to a block it already has
+    CValidationState stateTooLate;
+    BOOST_CHECK(!ActivateUTXOSnapshot(path, stateTooLate));
+
+    // Take the chain back, keeping the headers and blocks of the snapshot around
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindexFirstUndone = chainActive[91];
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), pindexFirstUndone));
+        BOOST_CHECK_EQUAL(chainActive.Height(), 90);
+        BOOST_CHECK(ReconsiderBlock(state, pindexFirstUndone));
+        BOOST_CHECK(pcoinsTip->GetBestBlock() != pindexBase->GetBlockHash());
+    }
+
+    CCoinsViewDB dbExpected(1 << 20, true);
+    CUTXOCommitment commitment;
+    BOOST_CHECK(LoadUTXOSnapshot(path, &dbExpected, header, nCoins, commitment));
+
+    BOOST_CHECK(ActivateUTXOSnapshot(path, state));
+    BOOST_CHECK(chainActive.Tip() == pindexBase);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == pindexBase->GetBlockHash());
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+    }
+    CheckSameCoins(*pcoinsdbview, dbExpected);
+
+    // The chain carries on from the snapshot
+    std::vector<CMutableTransaction> noTxns;
+    CreateAndProcessBlock(noTxns, CScript() << OP_TRUE);
+    BOOST_CHECK(chainActive.Tip()->pprev == pindexBase);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
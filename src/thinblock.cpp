@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 
+#include "blockcache.h"
 #include "chainparams.h"
 #include "connmgr.h"
 #include "consensus/merkle.h"
@@ -148,7 +149,7 @@ bool CThinBlock::process(CNode *pfrom, int nSizeThinBlock)
 
     // Check that the merkleroot matches the merkelroot calculated from the hashes provided.
     bool mutated;
-    uint256 merkleroot = ComputeMerkleRoot(vTxHashes, &mutated);
+    uint256 merkleroot = PV ? PV->MerkleRoot(vTxHashes, &mutated) : ComputeMerkleRoot(vTxHashes, &mutated);
     if (header.hashMerkleRoot != merkleroot || mutated)
     {
         thindata.ClearThinBlockData(pfrom, header.GetHash());
@@ -359,7 +360,8 @@ bool CXThinBlockTx::HandleMessage(CDataStream &vRecv, CNode *pfrom)
     // At this point we should have all the full hashes in the block. Check that the merkle
     // root in the block header matches the merkel root calculated from the hashes provided.
     bool mutated;
-    uint256 merkleroot = ComputeMerkleRoot(pfrom->thinBlockHashes, &mutated);
+    uint256 merkleroot = PV ? PV->MerkleRoot(pfrom->thinBlockHashes, &mutated) :
+                              ComputeMerkleRoot(pfrom->thinBlockHashes, &mutated);
     if (pfrom->thinBlock.hashMerkleRoot != merkleroot || mutated)
     {
         thindata.ClearThinBlockData(pfrom, inv.hash);
@@ -485,9 +487,8 @@ bool CXRequestThinBlockTx::HandleMessage(CDataStream &vRecv, CNode *pfrom)
         }
         else
         {
-            CBlock block;
-            const Consensus::Params &consensusParams = Params().GetConsensus();
-            if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+            std::shared_ptr<const CBlock> pblock = ReadServedBlock((*mi).second, Params().GetConsensus());
+            if (!pblock)
             {
                 // We do not assign misbehavior for not being able to read a block from disk because we already
                 // know that the block is in the block index from the step above. Secondly, a failure to read may
@@ -496,6 +497,7 @@ bool CXRequestThinBlockTx::HandleMessage(CDataStream &vRecv, CNode *pfrom)
             }
             else
             {
+                const CBlock &block = *pblock;
                 for (unsigned int i = 0; i < block.vtx.size(); i++)
                 {
                     uint64_t cheapHash = block.vtx[i].GetHash().GetCheapHash();
@@ -763,7 +765,8 @@ bool CXThinBlock::process(CNode *pfrom,
             if (setHashesToRequest.empty())
             {
                 bool mutated;
-                uint256 merkleroot = ComputeMerkleRoot(pfrom->thinBlockHashes, &mutated);
+                uint256 merkleroot = PV ? PV->MerkleRoot(pfrom->thinBlockHashes, &mutated) :
+                                          ComputeMerkleRoot(pfrom->thinBlockHashes, &mutated);
                 if (header.hashMerkleRoot != merkleroot || mutated)
                 {
                     fMerkleRootCorrect = false;
@@ -1492,7 +1495,7 @@ void AddThinBlockInFlight(CNode *pfrom, uint256 hash)
         std::pair<uint256, CNode::CThinBlockInFlight>(hash, CNode::CThinBlockInFlight()));
 }
 
-void SendXThinBlock(CBlock &block, CNode *pfrom, const CInv &inv)
+void SendXThinBlock(const CBlock &block, CNode *pfrom, const CInv &inv)
 {
     if (inv.type == MSG_XTHINBLOCK)
     {
@@ -241,7 +241,7 @@ void CheckNodeSupportForThinBlocks();
 bool ClearLargestThinBlockAndDisconnect(CNode *pfrom);
 void ClearThinBlockInFlight(CNode *pfrom, uint256 hash);
 void AddThinBlockInFlight(CNode *pfrom, uint256 hash);
-void SendXThinBlock(CBlock &block, CNode *pfrom, const CInv &inv);
+void SendXThinBlock(const CBlock &block, CNode *pfrom, const CInv &inv);
 bool IsThinBlockValid(CNode *pfrom, const std::vector<CTransaction> &vMissingTx, const CBlockHeader &header);
 void BuildSeededBloomFilter(CBloomFilter &memPoolFilter,
     std::vector<uint256> &vOrphanHashes,
@@ -0,0 +1,42 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXADMISSION_H
+#define BITCOIN_TXADMISSION_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+
+#include <stddef.h>
+
+namespace boost
+{
+class thread_group;
+}
+
+/** Default number of threads that admit transactions received from peers to the mempool, 0 = none */
+static const int DEFAULT_TXADMISSION_THREADS = 4;
+/** Maximum number of transaction admission threads */
+static const int MAX_TXADMISSION_THREADS = 64;
+
+/**
+ * Validate a transaction received from a peer and add it to the mempool, then relay it, resolve the orphans that
+ * were waiting for it and reject or punish the peer as the TX message handler has always done.  Called without
+ * cs_main held, the lock is only taken around the parts of the admission that need it.
+ */
+void ProcessTxForAdmission(const CTransaction &tx, NodeId nodeid, bool fWhitelisted);
+
+/**
+ * Hand a transaction received from a peer to the admission threads.  Without admission threads it is processed
+ * on the calling thread before returning.
+ */
+void EnqueueTxForAdmission(const CTransaction &tx, NodeId nodeid, bool fWhitelisted);
+
+/** The number of transactions waiting for an admission thread */
+size_t TxAdmissionQueueSize();
+
+/** Start -txadmissionthreads threads that take transactions off the admission queue. */
+void StartTxAdmission(boost::thread_group &threadGroup);
+
+#endif // BITCOIN_TXADMISSION_H
@@ -9,13 +9,18 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
 #include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
 
 #include <stdint.h>
 
+#include <atomic>
+
 using namespace std;
 
 static const char DB_COIN = 'C';
@@ -25,6 +30,7 @@ static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_UTXO_COMMITMENT = 'U';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
@@ -70,7 +76,27 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage)
+bool CCoinsViewDB::GetCommitment(CUTXOCommitment &commitment) const
+{
+    LOCK(cs_utxo);
+    if (db.Read(DB_UTXO_COMMITMENT, commitment))
+        return true;
+    if (db.Exists(DB_BEST_BLOCK))
+        return false;
+
+    // A database without a best block is empty, which the empty commitment describes, unless loading a
+    // snapshot into it was interrupted
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper *>(&db)->NewIterator());
+    pcursor->Seek(DB_COIN);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    if (pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN)
+        return false;
+    commitment = CUTXOCommitment();
+    return true;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, const CUTXOCommitment *pcommitment)
 {
     LOCK(cs_utxo);
     CDBBatch batch(db);
@@ -78,60 +104,41 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, siz
     size_t changed = 0;
     size_t nBatchSize = 0;
     size_t nBatchWrites = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
     {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY)
-        {
-            CoinEntry entry(&it->first);
-            size_t nUsage = it->second.coin.DynamicMemoryUsage();
-            if (it->second.coin.IsSpent())
-            {
-                batch.Erase(entry);
-
-                // Update the usage of the child cache before deleting the entry in the child cache
-                nChildCachedCoinsUsage -= nUsage;
-                it = mapCoins.erase(it);
-            }
-            else
-            {
-                batch.Write(entry, it->second.coin);
-
-                // Only delete valid coins from the cache when we're nearly syncd.  During IBD, and also
-                // if BlockOnly mode is turned on, these coins will be used, whereas, once the chain is
-                // syncd we only need the coins that have come from accepting txns into the memory pool.
-                bool fBlocksOnly = GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY);
-                if (IsChainNearlySyncd() && !fImporting && !fReindex && !fBlocksOnly)
-                {
-                    // Update the usage of the child cache before deleting the entry in the child cache
-                    nChildCachedCoinsUsage -= nUsage;
-                    it = mapCoins.erase(it);
-                }
-                else
-                {
-                    it->second.flags = 0;
-                    it++;
-                }
-            }
-            changed++;
+        count++;
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
 
-            // In order to prevent the spikes in memory usage that used to happen when we prepared large as
-            // was possible, we instead break up the batches such that the performance gains for writing to
-            // leveldb are still realized but the memory spikes are not seen.
-            nBatchSize += nUsage;
-            if (nBatchSize > nCoinCacheUsage * 0.01)
-            {
-                db.WriteBatch(batch);
-                batch.Clear();
-                nBatchSize = 0;
-                nBatchWrites++;
-            }
-        }
+        CoinEntry entry(&it->first);
+        if (it->second.coin.IsSpent())
+            batch.Erase(entry);
         else
-            it++;
-        count++;
+            batch.Write(entry, it->second.coin);
+        changed++;
+
+        // In order to prevent the spikes in memory usage that used to happen when we prepared large as
+        // was possible, we instead break up the batches such that the performance gains for writing to
+        // leveldb are still realized but the memory spikes are not seen.
+        nBatchSize += it->second.coin.DynamicMemoryUsage();
+        if (nBatchSize > nCoinCacheUsage * 0.01)
+        {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBatchSize = 0;
+            nBatchWrites++;
+        }
     }
+    // The best block goes into the last batch, so after a crash the database never claims a state
+    // whose coins were not all written.  Same for the commitment, which must not outlive the coins it
+    // describes.
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (pcommitment)
+        batch.Write(DB_UTXO_COMMITMENT, *pcommitment);
+    else
+        batch.Erase(DB_UTXO_COMMITMENT);
 
     bool ret = db.WriteBatch(batch);
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database with %u batch writes...\n",
@@ -139,6 +146,294 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, siz
     return ret;
 }
 
+bool CCoinsViewDB::WriteSortedCoins(const std::vector<std::pair<COutPoint, Coin> > &vCoins,
+    const uint256 &hashBlock,
+    const CUTXOCommitment *pcommitment)
+{
+    LOCK(cs_utxo);
+    CDBBatch batch(db);
+    for (const auto &item : vCoins)
+        batch.Write(CoinEntry(&item.first), item.second);
+    if (!hashBlock.IsNull())
+    {
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+        if (pcommitment)
+            batch.Write(DB_UTXO_COMMITMENT, *pcommitment);
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::WipeCoins()
+{
+    LOCK(cs_utxo);
+    {
+        CDBBatch batch(db);
+        batch.Erase(DB_BEST_BLOCK);
+        batch.Erase(DB_UTXO_COMMITMENT);
+        if (!db.WriteBatch(batch, true))
+            return false;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(db);
+    size_t nErased = 0;
+    for (pcursor->Seek(DB_COIN); pcursor->Valid(); pcursor->Next())
+    {
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN)
+            break;
+        batch.Erase(entry);
+        if (++nErased % 100000 == 0)
+        {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    LogPrint("coindb", "Erased %u coins from the coin database\n", (unsigned int)nErased);
+    return db.WriteBatch(batch, true);
+}
+
+bool CCoinsViewDB::RebuildCommitment(int nThreads)
+{
+    // The commitments of the ranges are combined in order, though the result does not depend on it
+    CUTXOCommitment commitment;
+    std::vector<CUTXOCommitment> vRangeCommitments(DEFAULT_COIN_SCAN_RANGES);
+    uint256 hashBlock;
+    auto scan = [&vRangeCommitments](int nRange, CCoinsViewCursor &cursor) {
+        for (; cursor.Valid(); cursor.Next())
+        {
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin))
+                return error("%s: Unable to read coin database", __func__);
+            vRangeCommitments[nRange].Add(key, coin);
+        }
+        return true;
+    };
+    auto merge = [&commitment, &vRangeCommitments](int nRange) {
+        commitment += vRangeCommitments[nRange];
+        return true;
+    };
+    if (!ScanCoinRanges(vRangeCommitments.size(), nThreads, scan, merge, hashBlock))
+        return error("%s: Unable to go through the coin database", __func__);
+
+    LOCK(cs_utxo);
+    if (GetBestBlock() != hashBlock)
+        return error("%s: Coin database changed while computing its commitment", __func__);
+    CDBBatch batch(db);
+    batch.Write(DB_UTXO_COMMITMENT, commitment);
+    LogPrintf("Computed the UTXO set commitment over %u coins\n", commitment.nTransactionOutputs);
+    return db.WriteBatch(batch, true);
+}
+
+/** Remove or clean the dirty entries of a cache that have just been handed to the database. */
+static void ReleaseFlushedCoins(CCoinsMap &mapCoins, size_t &nChildCachedCoinsUsage)
+{
+    // Only delete valid coins from the cache when we're nearly syncd.  During IBD, and also
+    // if BlockOnly mode is turned on, these coins will be used, whereas, once the chain is
+    // syncd we only need the coins that have come from accepting txns into the memory pool.
+    bool fBlocksOnly = GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY);
+    bool fEraseUnspent = IsChainNearlySyncd() && !fImporting && !fReindex && !fBlocksOnly;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
+    {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            it++;
+        else if (it->second.coin.IsSpent() || fEraseUnspent)
+        {
+            // Update the usage of the child cache before deleting the entry in the child cache
+            nChildCachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = mapCoins.erase(it);
+        }
+        else
+        {
+            it->second.flags = 0;
+            it++;
+        }
+    }
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
+    const uint256 &hashBlock,
+    const CUTXOCommitment *pcommitment,
+    size_t &nChildCachedCoinsUsage)
+{
+    bool ret = WriteCoins(mapCoins, hashBlock, pcommitment);
+    ReleaseFlushedCoins(mapCoins, nChildCachedCoinsUsage);
+    return ret;
+}
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsViewDB *dbIn)
+    : db(dbIn), fHaveSnapshotCommitment(false), fWriting(false), fWriteFailed(false), fShutdown(false)
+{
+    writerThread = boost::thread(&CCoinsViewBackgroundFlush::ThreadWriteCoins, this);
+}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_flush);
+        fShutdown = true;
+    }
+    cond.notify_all();
+    // The writer finishes the write in flight before it exits
+    writerThread.join();
+}
+
+void CCoinsViewBackgroundFlush::ThreadWriteCoins()
+{
+    RenameThread("bitcoin-coinsflush");
+    boost::unique_lock<boost::mutex> lock(cs_flush);
+    while (true)
+    {
+        while (!fWriting && !fShutdown)
+            cond.wait(lock);
+        if (!fWriting)
+            return;
+
+        // Nobody modifies the snapshot while fWriting is set, and readers only look at it, so it can be
+        // written without holding the lock.
+        lock.unlock();
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try
+        {
+            fOk = db->WriteCoins(mapSnapshot, hashSnapshotBlock, fHaveSnapshotCommitment ? &commitmentSnapshot : nullptr);
+        }
+        catch (const std::exception &e)
+        {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "Background write of %u coins took %.2fms\n", (unsigned int)mapSnapshot.size(),
+            0.001 * (GetTimeMicros() - nStart));
+        lock.lock();
+
+        // Keep the coins around after a failure, so that lookups stay correct until the node shuts down
+        if (fOk)
+            mapSnapshot.clear();
+        fWriteFailed = !fOk;
+        fWriting = false;
+        cond.notify_all();
+    }
+}
+
+bool CCoinsViewBackgroundFlush::WaitForWrite(boost::unique_lock<boost::mutex> &lock) const
+{
+    while (fWriting)
+        cond.wait(lock);
+    return !fWriteFailed;
+}
+
+bool CCoinsViewBackgroundFlush::WaitForWrite() const
+{
+    boost::unique_lock<boost::mutex> lock(cs_flush);
+    return WaitForWrite(lock);
+}
+
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_flush);
+        CCoinsMap::const_iterator it = mapSnapshot.find(outpoint);
+        if (it != mapSnapshot.end())
+        {
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    // Anything not in the snapshot is the same in the database, whether or not a write is in flight
+    return db->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_flush);
+        CCoinsMap::const_iterator it = mapSnapshot.find(outpoint);
+        if (it != mapSnapshot.end())
+            return !it->second.coin.IsSpent();
+    }
+    return db->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_flush);
+        if ((fWriting || !mapSnapshot.empty()) && !hashSnapshotBlock.IsNull())
+            return hashSnapshotBlock;
+    }
+    return db->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::GetCommitment(CUTXOCommitment &commitment) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_flush);
+        if ((fWriting || !mapSnapshot.empty()) && !hashSnapshotBlock.IsNull())
+        {
+            if (fHaveSnapshotCommitment)
+                commitment = commitmentSnapshot;
+            return fHaveSnapshotCommitment;
+        }
+    }
+    return db->GetCommitment(commitment);
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins,
+    const uint256 &hashBlock,
+    const CUTXOCommitment *pcommitment,
+    size_t &nChildCachedCoinsUsage)
+{
+    boost::unique_lock<boost::mutex> lock(cs_flush);
+    if (fWriting)
+    {
+        int64_t nStart = GetTimeMicros();
+        bool fOk = WaitForWrite(lock);
+        LogPrint("coindb", "Waited %.2fms for the previous coin database write\n", 0.001 * (GetTimeMicros() - nStart));
+        if (!fOk)
+            return false;
+    }
+    else if (fWriteFailed)
+        return false;
+
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
+    {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+        {
+            CCoinsCacheEntry &entry = mapSnapshot[it->first];
+            entry.coin = it->second.coin;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+    }
+    hashSnapshotBlock = hashBlock;
+    fHaveSnapshotCommitment = (pcommitment != nullptr);
+    if (fHaveSnapshotCommitment)
+        commitmentSnapshot = *pcommitment;
+    ReleaseFlushedCoins(mapCoins, nChildCachedCoinsUsage);
+
+    fWriting = true;
+    cond.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewBackgroundFlush::Cursor() const
+{
+    // A cursor only sees the database, so it has to wait for the coins in flight
+    WaitForWrite();
+    return db->Cursor();
+}
+
+size_t CCoinsViewBackgroundFlush::EstimateSize() const { return db->EstimateSize(); }
+size_t CCoinsViewBackgroundFlush::DynamicMemoryUsage() const
+{
+    boost::unique_lock<boost::mutex> lock(cs_flush);
+    return mapSnapshot.DynamicMemoryUsage();
+}
+
 size_t CCoinsViewDB::EstimateSize() const { return db.EstimateSize(DB_COIN, (char)(DB_COIN + 1)); }
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -173,17 +468,142 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid())
-    {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
-    }
-    else
+    i->ReadKey();
+    return i;
+}
+
+uint256 CCoinsViewDB::GetBestBlock(const std::shared_ptr<const leveldb::Snapshot> &snapshot) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper *>(&db)->NewIterator(snapshot));
+    pcursor->Seek(DB_BEST_BLOCK);
+    char key;
+    uint256 hashBestChain;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key != DB_BEST_BLOCK || !pcursor->GetValue(hashBestChain))
+        return uint256();
+    return hashBestChain;
+}
+
+/** The lowest txid of range nRange when the txids are split into nRanges ranges by their first two bytes */
+static uint256 RangeBegin(int nRange, int nRanges)
+{
+    uint256 hash;
+    uint32_t nPrefix = ((uint64_t)nRange * MAX_COIN_RANGES) / nRanges;
+    hash.begin()[0] = nPrefix >> 8;
+    hash.begin()[1] = nPrefix & 0xff;
+    return hash;
+}
+
+CCoinsViewCursor *CCoinsViewDB::RangeCursor(const std::shared_ptr<const leveldb::Snapshot> &snapshot,
+    const uint256 &hashBlock,
+    int nRange,
+    int nRanges) const
+{
+    assert(nRange >= 0 && nRange < nRanges && nRanges <= MAX_COIN_RANGES);
+    // The last range has no end, it goes on to the last coin
+    uint256 hashEnd = RangeBegin(nRange + 1, nRanges);
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper *>(&db)->NewIterator(snapshot), hashBlock,
+        nRange + 1 < nRanges ? &hashEnd : nullptr);
+    COutPoint begin(RangeBegin(nRange, nRanges), 0);
+    i->pcursor->Seek(CoinEntry(&begin));
+    i->ReadKey();
+    return i;
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor> > CCoinsViewDB::RangeCursors(int nRanges) const
+{
+    nRanges = std::max(1, std::min(nRanges, MAX_COIN_RANGES));
+    std::shared_ptr<const leveldb::Snapshot> snapshot = const_cast<CDBWrapper *>(&db)->GetSnapshot();
+    uint256 hashBlock = GetBestBlock(snapshot);
+    std::vector<std::unique_ptr<CCoinsViewCursor> > vCursors;
+    for (int nRange = 0; nRange < nRanges; nRange++)
+        vCursors.emplace_back(RangeCursor(snapshot, hashBlock, nRange, nRanges));
+    return vCursors;
+}
+
+bool CCoinsViewDB::ScanCoinRanges(int nRanges,
+    int nThreads,
+    const std::function<bool(int nRange, CCoinsViewCursor &cursor)> &fnScan,
+    const std::function<bool(int nRange)> &fnMerge,
+    uint256 &hashBlock) const
+{
+    nRanges = std::max(1, std::min(nRanges, MAX_COIN_RANGES));
+    nThreads = std::max(1, std::min(nThreads, nRanges));
+    // How far the scans may get ahead of the merge
+    const int nWindow = 4 * nThreads;
+
+    std::shared_ptr<const leveldb::Snapshot> snapshot = const_cast<CDBWrapper *>(&db)->GetSnapshot();
+    hashBlock = GetBestBlock(snapshot);
+
+    // The workers refer to the state on this stack, so this thread must not be interrupted before they are joined
+    boost::this_thread::disable_interruption noInterrupt;
+    boost::mutex cs_scan;
+    boost::condition_variable cond;
+    //! Per range: 0 while not scanned yet, 1 when scanned, -1 when the scan failed
+    std::vector<int> vScanned(nRanges, 0);
+    int nNextRange = 0;
+    int nMerged = 0;
+    bool fAbort = false;
+
+    auto scanRanges = [&]() {
+        while (true)
+        {
+            int nRange;
+            {
+                boost::unique_lock<boost::mutex> lock(cs_scan);
+                while (!fAbort && nNextRange < nRanges && nNextRange >= nMerged + nWindow)
+                    cond.wait(lock);
+                if (fAbort || nNextRange == nRanges)
+                    return;
+                nRange = nNextRange++;
+            }
+            bool fScanned = false;
+            try
+            {
+                std::unique_ptr<CCoinsViewCursor> pcursor(RangeCursor(snapshot, hashBlock, nRange, nRanges));
+                fScanned = fnScan(nRange, *pcursor);
+            }
+            catch (const std::exception &e)
+            {
+                LogPrintf("%s: scan of range %d failed: %s\n", __func__, nRange, e.what());
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(cs_scan);
+                vScanned[nRange] = fScanned ? 1 : -1;
+            }
+            cond.notify_all();
+        }
+    };
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(scanRanges);
+
+    bool fSuccess = true;
+    for (int nRange = 0; nRange < nRanges && fSuccess; nRange++)
     {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        {
+            boost::unique_lock<boost::mutex> lock(cs_scan);
+            while (vScanned[nRange] == 0)
+                cond.wait(lock);
+            fSuccess = vScanned[nRange] > 0;
+        }
+        try
+        {
+            fSuccess = fSuccess && !ShutdownRequested() && fnMerge(nRange);
+        }
+        catch (const std::exception &e)
+        {
+            LogPrintf("%s: merge of range %d failed: %s\n", __func__, nRange, e.what());
+            fSuccess = false;
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(cs_scan);
+            nMerged = nRange + 1;
+            fAbort = !fSuccess;
+        }
+        cond.notify_all();
     }
-    return i;
+    threadGroup.join_all();
+    return fSuccess;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -203,8 +623,13 @@ bool CCoinsViewDBCursor::Valid() const { return keyTmp.first == DB_COIN; }
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
+    ReadKey();
+}
+
+void CCoinsViewDBCursor::ReadKey()
+{
     CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry))
+    if (!pcursor->Valid() || !pcursor->GetKey(entry) || (fHasEnd && !(keyTmp.second.hash < hashEnd)))
     {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     }
@@ -255,53 +680,105 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue)
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::LoadBlockIndexRange(const std::shared_ptr<const leveldb::Snapshot> &snapshot,
+    int nRange,
+    int nRanges,
+    std::vector<std::pair<uint256, CDiskBlockIndex> > &vEntries)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
-
-    // Load mapBlockIndex
-    while (pcursor->Valid())
+    // The ranges split the entries by the first byte of their hash, which is the most significant one in
+    // the order of the keys
+    int nBegin = (nRange * 256) / nRanges;
+    int nEnd = ((nRange + 1) * 256) / nRanges;
+    uint256 hashBegin;
+    hashBegin.begin()[0] = nBegin;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+    for (pcursor->Seek(make_pair(DB_BLOCK_INDEX, hashBegin)); pcursor->Valid(); pcursor->Next())
     {
-        boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX)
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || key.second.begin()[0] >= nEnd)
+            break;
+        vEntries.emplace_back();
+        CDiskBlockIndex &diskindex = vEntries.back().second;
+        if (!pcursor->GetValue(diskindex))
+            return error("LoadBlockIndex() : failed to read value");
+        vEntries.back().first = diskindex.GetBlockHash();
+        if (!CheckProofOfWork(vEntries.back().first, diskindex.nBits, Params().GetConsensus()))
+            return error("LoadBlockIndex(): CheckProofOfWork failed: %s", diskindex.ToString());
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    // Reading the entries and checking their proof of work is done on several threads, each going through
+    // its own ranges of hashes in a snapshot of the database.
+    const int nThreads = std::max(1, GetNumCores());
+    const int nRanges = std::min(256, 8 * nThreads);
+    std::shared_ptr<const leveldb::Snapshot> snapshot = GetSnapshot();
+    std::vector<std::vector<std::pair<uint256, CDiskBlockIndex> > > vRanges(nRanges);
+    std::atomic<int> nNextRange(0);
+    std::atomic<bool> fFailed(false);
+    auto loadRanges = [&]() {
+        for (int nRange = nNextRange++; nRange < nRanges && !fFailed; nRange = nNextRange++)
         {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex))
+            try
             {
-                // Construct block index object
-                CBlockIndex *pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
+                if (!LoadBlockIndexRange(snapshot, nRange, nRanges, vRanges[nRange]))
+                    fFailed = true;
             }
-            else
+            catch (const std::exception &e)
             {
-                return error("LoadBlockIndex() : failed to read value");
+                LogPrintf("LoadBlockIndex(): %s\n", e.what());
+                fFailed = true;
             }
         }
-        else
-        {
-            break;
-        }
+    };
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(loadRanges);
+    threadGroup.join_all();
+    if (fFailed)
+        return false;
+
+    boost::this_thread::interruption_point();
+
+    // Adding the entries to mapBlockIndex is done here, in height order, so that the entries of a chain are
+    // next to each other in memory
+    std::vector<std::pair<uint256, CDiskBlockIndex> *> vSorted;
+    for (auto &vEntries : vRanges)
+        for (auto &entry : vEntries)
+            vSorted.push_back(&entry);
+    std::sort(vSorted.begin(), vSorted.end(),
+        [](const std::pair<uint256, CDiskBlockIndex> *a, const std::pair<uint256, CDiskBlockIndex> *b) {
+            return a->second.nHeight < b->second.nHeight;
+        });
+    poolBlockIndex.Reserve(vSorted.size());
+    mapBlockIndex.reserve(mapBlockIndex.size() + vSorted.size());
+    std::vector<CBlockIndex *> vIndex;
+    vIndex.reserve(vSorted.size());
+    for (const auto *pentry : vSorted)
+    {
+        const CDiskBlockIndex &diskindex = pentry->second;
+        CBlockIndex *pindexNew = InsertBlockIndex(pentry->first);
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nFile = diskindex.nFile;
+        pindexNew->nDataPos = diskindex.nDataPos;
+        pindexNew->nUndoPos = diskindex.nUndoPos;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = diskindex.nStatus;
+        pindexNew->nTx = diskindex.nTx;
+        vIndex.push_back(pindexNew);
     }
 
+    // Link the entries once they all exist.  A predecessor missing from the database gets an empty entry.
+    for (size_t i = 0; i < vSorted.size(); i++)
+        vIndex[i]->pprev = InsertBlockIndex(vSorted[i]->second.hashPrev);
+
     return true;
 }
 
@@ -11,11 +11,15 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread.hpp>
+
 
 class CBlockFileInfo;
 class CBlockIndex;
@@ -37,6 +41,12 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+//! The coins database can be split into at most this many ranges, by the first two bytes of the txids
+static const int MAX_COIN_RANGES = 1 << 16;
+//! Number of ranges a parallel scan of the coins database goes through
+static const int DEFAULT_COIN_SCAN_RANGES = 1024;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -72,6 +82,13 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CDBWrapper db;
 
+    //! The best block marker as it was when the snapshot was taken
+    uint256 GetBestBlock(const std::shared_ptr<const leveldb::Snapshot> &snapshot) const;
+    //! A cursor over the coins of range nRange of nRanges, as they were when the snapshot was taken
+    CCoinsViewCursor *RangeCursor(const std::shared_ptr<const leveldb::Snapshot> &snapshot,
+        const uint256 &hashBlock,
+        int nRange,
+        int nRanges) const;
 
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
@@ -79,12 +96,109 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t &nChildCachedCoinsUsage) override;
+    bool GetCommitment(CUTXOCommitment &commitment) const override;
+    bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Cursors over nRanges disjoint ranges of the coins, which one after the other go through all coins
+     * in the order of Cursor().  The ranges split the txids by their first two bytes, which are uniformly
+     * distributed, so the ranges hold about the same number of coins.  All cursors see the database as
+     * it was when they were created, even while it is written to, and can be used on separate threads.
+     */
+    std::vector<std::unique_ptr<CCoinsViewCursor> > RangeCursors(int nRanges) const;
+
+    /**
+     * Go through the coins on nThreads threads, split into nRanges ranges as by RangeCursors().
+     *
+     * fnScan is called on one of the worker threads for each range, with a cursor over it.  fnMerge is
+     * called on the calling thread for each range in turn, in keyspace order, once its scan is done.  So
+     * results kept per range and combined in fnMerge come out the same as from a single cursor, however
+     * the threads are scheduled.  Scans are never more than a few ranges ahead of the merge, which bounds
+     * the memory held by results waiting to be merged.  hashBlock is set to the block the coins are for.
+     * Returns false, after stopping the other scans, as soon as a call returns false or throws.
+     */
+    bool ScanCoinRanges(int nRanges,
+        int nThreads,
+        const std::function<bool(int nRange, CCoinsViewCursor &cursor)> &fnScan,
+        const std::function<bool(int nRange)> &fnMerge,
+        uint256 &hashBlock) const;
+
+    /**
+     * Write the dirty entries of mapCoins and then the best block marker together with the commitment,
+     * leaving mapCoins untouched.  The stored commitment is erased when pcommitment is NULL.
+     */
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, const CUTXOCommitment *pcommitment);
+    //! Write coins in the order given, and then the best block marker and commitment if hashBlock is not null
+    bool WriteSortedCoins(const std::vector<std::pair<COutPoint, Coin> > &vCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment);
+    //! Erase the best block marker and commitment and then all coins
+    bool WipeCoins();
+    //! Compute the commitment of a database that has none by going through all coins, and store it
+    bool RebuildCommitment(int nThreads = 1);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! The database itself, for its write mode and statistics
+    CDBWrapper &GetDB() { return db; }
+};
+
+/**
+ * CCoinsView that sits between the coins cache and the coin database and writes flushed coins to
+ * the database on a background thread.
+ *
+ * BatchWrite copies the dirty entries of the child cache into a snapshot and returns as soon as the
+ * child has been cleaned up, so that the caller (and cs_main) are not held up by the database write.
+ * Until the write has finished, lookups are answered from the snapshot first.  Only one write is in
+ * flight at a time: a following BatchWrite waits for the previous one, so writes reach the database
+ * in order and the best block marker, which is written last, always describes a complete state.
+ */
+class CCoinsViewBackgroundFlush : public CCoinsView
+{
+private:
+    CCoinsViewDB *db;
+
+    mutable boost::mutex cs_flush;
+    mutable boost::condition_variable cond;
+    //! The coins being written, read only while fWriting is set
+    CCoinsMap mapSnapshot;
+    uint256 hashSnapshotBlock;
+    CUTXOCommitment commitmentSnapshot;
+    bool fHaveSnapshotCommitment;
+    bool fWriting;
+    bool fWriteFailed;
+    bool fShutdown;
+    boost::thread writerThread;
+
+    void ThreadWriteCoins();
+    //! Wait for the write in flight, returns false if it failed.  cs_flush must be held.
+    bool WaitForWrite(boost::unique_lock<boost::mutex> &lock) const;
+
+public:
+    CCoinsViewBackgroundFlush(CCoinsViewDB *dbIn);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool GetCommitment(CUTXOCommitment &commitment) const override;
+    bool BatchWrite(CCoinsMap &mapCoins,
+        const uint256 &hashBlock,
+        const CUTXOCommitment *pcommitment,
+        size_t &nChildCachedCoinsUsage) override;
+    CCoinsViewCursor *Cursor() const override;
+    size_t EstimateSize() const override;
+
+    //! Block until the coins handed over so far are in the database, returns false if writing them failed.
+    bool WaitForWrite() const;
+    //! Memory used by the coins that are waiting to be written
+    size_t DynamicMemoryUsage() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -100,12 +214,20 @@ public:
     void Next();
 
 private:
-    CCoinsViewDBCursor(CDBIterator *pcursorIn, const uint256 &hashBlockIn)
-        : CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn)
+    CCoinsViewDBCursor(CDBIterator *pcursorIn, const uint256 &hashBlockIn, const uint256 *phashEndIn = nullptr)
+        : CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), fHasEnd(phashEndIn != nullptr)
     {
+        if (fHasEnd)
+            hashEnd = *phashEndIn;
     }
+    //! Cache the key of the record pcursor is at, or mark the cursor invalid if there is none in range
+    void ReadKey();
+
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! If set, the cursor stops before the first coin whose txid is not below hashEnd
+    bool fHasEnd;
+    uint256 hashEnd;
 
     friend class CCoinsViewDB;
 };
@@ -132,7 +254,15 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! Load the block index into mapBlockIndex, reading it on several threads
     bool LoadBlockIndexGuts();
+
+private:
+    //! Read and check the entries of range nRange of nRanges, split by the first byte of the block hash
+    bool LoadBlockIndexRange(const std::shared_ptr<const leveldb::Snapshot> &snapshot,
+        int nRange,
+        int nRanges,
+        std::vector<std::pair<uint256, CDiskBlockIndex> > &vEntries);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -36,6 +36,7 @@
 #include "validationinterface.h"
 #include "version.h"
 
+#include <stack>
 #include <atomic>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
@@ -0,0 +1,236 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/thread/thread.hpp> // boost::this_thread::interruption_point
+
+static const unsigned char UTXO_SNAPSHOT_MAGIC[4] = {'u', 't', 'x', 'o'};
+
+//! Number of coins written to the database per batch while loading a snapshot
+static const size_t SNAPSHOT_LOAD_BATCH_COINS = 100000;
+
+template <typename Stream>
+static bool ReadHeader(Stream &s, CUTXOSnapshotHeader &header)
+{
+    unsigned char pchMagic[4];
+    unsigned char pchMessageStart[4];
+    s >> FLATDATA(pchMagic) >> FLATDATA(pchMessageStart);
+    if (memcmp(pchMagic, UTXO_SNAPSHOT_MAGIC, sizeof(pchMagic)))
+        return error("%s: Not a UTXO snapshot", __func__);
+    if (memcmp(pchMessageStart, Params().MessageStart(), sizeof(pchMessageStart)))
+        return error("%s: Invalid network magic number", __func__);
+    s >> header;
+    if (header.nVersion != UTXO_SNAPSHOT_VERSION)
+        return error("%s: Unsupported snapshot version %u", __func__, header.nVersion);
+    return true;
+}
+
+bool DumpUTXOSnapshot(CCoinsViewCursor *pcursor,
+    const fs::path &path,
+    CUTXOSnapshotHeader &header,
+    uint64_t &nCoins,
+    uint256 &hashFile)
+{
+    // Write to a temporary file next to the destination and only rename it once it is complete
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char *)&randv, sizeof(randv));
+    fs::path pathTmp = path;
+    pathTmp += strprintf(".%04x", randv);
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+    header = CUTXOSnapshotHeader();
+    header.hashBaseBlock = pcursor->GetBestBlock();
+    nCoins = 0;
+    try
+    {
+        // Everything is serialized into ss first, so that it can be hashed and written in one go
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(UTXO_SNAPSHOT_MAGIC) << FLATDATA(Params().MessageStart()) << header;
+
+        // The database is ordered by txid and then output index, so all outputs of a transaction are adjacent
+        std::vector<std::pair<uint32_t, Coin> > vOutputs;
+        uint256 hashTx;
+        while (true)
+        {
+            COutPoint key;
+            Coin coin;
+            bool fValid = pcursor->Valid();
+            if (fValid && !(pcursor->GetKey(key) && pcursor->GetValue(coin)))
+                return error("%s: Unable to read coin database", __func__);
+            if (!vOutputs.empty() && (!fValid || key.hash != hashTx))
+            {
+                ss << hashTx << VARINT(vOutputs.size());
+                for (const auto &output : vOutputs)
+                    ss << VARINT(output.first) << output.second;
+                nCoins += vOutputs.size();
+                vOutputs.clear();
+            }
+            if (!fValid)
+                break;
+            hashTx = key.hash;
+            vOutputs.push_back(std::make_pair(key.n, std::move(coin)));
+            pcursor->Next();
+
+            if (ss.size() > 1000000)
+            {
+                boost::this_thread::interruption_point();
+                hasher.write(ss.data(), ss.size());
+                fileout.write(ss.data(), ss.size());
+                ss.clear();
+            }
+        }
+        ss << uint256() << nCoins;
+        hasher.write(ss.data(), ss.size());
+        fileout.write(ss.data(), ss.size());
+        hashFile = hasher.GetHash();
+        fileout << hashFile;
+    }
+    catch (const std::exception &e)
+    {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+    LogPrintf("Wrote UTXO snapshot of %u coins at block %s to %s\n", nCoins, header.hashBaseBlock.ToString(),
+        path.string());
+    return true;
+}
+
+bool ReadUTXOSnapshotHeader(const fs::path &path, CUTXOSnapshotHeader &header)
+{
+    FILE *file = fsbridge::fopen(path, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: Failed to open file %s", __func__, path.string());
+    try
+    {
+        return ReadHeader(filein, header);
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+}
+
+/**
+ * Read a snapshot file, and when view is given, write its coins to the database as they are read, together
+ * with their commitment.
+ */
+static bool ReadUTXOSnapshot(const fs::path &path,
+    CCoinsViewDB *view,
+    CUTXOSnapshotHeader &header,
+    uint64_t &nCoins,
+    uint256 &hashFile,
+    CUTXOCommitment &commitment)
+{
+    FILE *file = fsbridge::fopen(path, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: Failed to open file %s", __func__, path.string());
+
+    nCoins = 0;
+    commitment = CUTXOCommitment();
+    try
+    {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        if (!ReadHeader(verifier, header))
+            return false;
+        if (view && !view->WipeCoins())
+            return error("%s: Failed to clear the coin database", __func__);
+
+        std::vector<std::pair<COutPoint, Coin> > vCoins;
+        vCoins.reserve(view ? SNAPSHOT_LOAD_BATCH_COINS : 0);
+        while (true)
+        {
+            uint256 hashTx;
+            verifier >> hashTx;
+            if (hashTx.IsNull())
+                break;
+            uint64_t nOutputs = 0;
+            verifier >> VARINT(nOutputs);
+            if (nOutputs == 0)
+                return error("%s: Snapshot contains a transaction without outputs", __func__);
+            for (uint64_t i = 0; i < nOutputs; i++)
+            {
+                uint32_t n = 0;
+                Coin coin;
+                verifier >> VARINT(n) >> coin;
+                nCoins++;
+                if (view)
+                {
+                    COutPoint outpoint(hashTx, n);
+                    commitment.Add(outpoint, coin);
+                    vCoins.push_back(std::make_pair(outpoint, std::move(coin)));
+                }
+            }
+            if (vCoins.size() >= SNAPSHOT_LOAD_BATCH_COINS)
+            {
+                boost::this_thread::interruption_point();
+                if (!view->WriteSortedCoins(vCoins, uint256(), nullptr))
+                    return error("%s: Failed to write to coin database", __func__);
+                vCoins.clear();
+            }
+        }
+        uint64_t nCoinsExpected = 0;
+        verifier >> nCoinsExpected;
+        if (nCoinsExpected != nCoins)
+            return error("%s: Snapshot claims %u coins but contains %u", __func__, nCoinsExpected, nCoins);
+
+        hashFile = verifier.GetHash();
+        uint256 hashIn;
+        filein >> hashIn;
+        if (hashIn != hashFile)
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+
+        // The best block marker goes in last, once every coin is known to be good
+        if (view && !view->WriteSortedCoins(vCoins, header.hashBaseBlock, &commitment))
+            return error("%s: Failed to write to coin database", __func__);
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool VerifyUTXOSnapshot(const fs::path &path, CUTXOSnapshotHeader &header, uint64_t &nCoins, uint256 &hashFile)
+{
+    CUTXOCommitment commitment;
+    return ReadUTXOSnapshot(path, NULL, header, nCoins, hashFile, commitment);
+}
+
+bool LoadUTXOSnapshot(const fs::path &path,
+    CCoinsViewDB *view,
+    CUTXOSnapshotHeader &header,
+    uint64_t &nCoins,
+    CUTXOCommitment &commitment)
+{
+    uint256 hashFile;
+    if (!ReadUTXOSnapshot(path, view, header, nCoins, hashFile, commitment))
+        return false;
+    LogPrintf("Loaded UTXO snapshot of %u coins at block %s from %s\n", nCoins, header.hashBaseBlock.ToString(),
+        path.string());
+    return true;
+}
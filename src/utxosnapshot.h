@@ -0,0 +1,75 @@
+// Copyright (c) 2017 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "fs.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class CCoinsViewCursor;
+class CCoinsViewDB;
+class CUTXOCommitment;
+
+/**
+ * A UTXO snapshot file holds the complete coin database as of one block, so that a new node can start
+ * from there instead of connecting every block since genesis.
+ *
+ * Layout: the magic bytes "utxo", the network magic, a CUTXOSnapshotHeader, then the coins grouped by
+ * txid in database order (txid, number of coins, and for each coin its output index and the Coin), a null
+ * txid, the total number of coins, and finally the double SHA256 of everything before it.
+ */
+
+//! Version of the snapshot format written by DumpUTXOSnapshot
+static const uint32_t UTXO_SNAPSHOT_VERSION = 1;
+
+class CUTXOSnapshotHeader
+{
+public:
+    uint32_t nVersion;
+    //! The block whose resulting UTXO set is in the snapshot
+    uint256 hashBaseBlock;
+
+    CUTXOSnapshotHeader() : nVersion(UTXO_SNAPSHOT_VERSION) {}
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(nVersion);
+        READWRITE(hashBaseBlock);
+    }
+};
+
+/**
+ * Write all coins a database cursor sees to a snapshot file.  The cursor is a consistent view of the
+ * database, so the caller does not have to hold any lock while this runs.
+ */
+bool DumpUTXOSnapshot(CCoinsViewCursor *pcursor,
+    const fs::path &path,
+    CUTXOSnapshotHeader &header,
+    uint64_t &nCoins,
+    uint256 &hashFile);
+
+/** Read and check the header of a snapshot file, without looking at the coins. */
+bool ReadUTXOSnapshotHeader(const fs::path &path, CUTXOSnapshotHeader &header);
+
+/** Read a whole snapshot file and check that it is complete and its checksum matches. */
+bool VerifyUTXOSnapshot(const fs::path &path, CUTXOSnapshotHeader &header, uint64_t &nCoins, uint256 &hashFile);
+
+/**
+ * Replace the contents of the coin database with the coins in a snapshot file.  The best block marker
+ * is removed first and only written once all coins are in, so an interrupted load is recognisable.
+ * The commitment of the loaded coins is computed on the way and stored with the best block.
+ */
+bool LoadUTXOSnapshot(const fs::path &path,
+    CCoinsViewDB *view,
+    CUTXOSnapshotHeader &header,
+    uint64_t &nCoins,
+    CUTXOCommitment &commitment);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "validationinterface.h"
+#include <boost/bind.hpp>
 
 static CMainSignals g_signals;
 